@@ -0,0 +1,204 @@
+
+#ifndef _admittance_h_
+#define _admittance_h_
+
+#include <eigen3/Eigen/Dense>
+#include <eigen3/unsupported/Eigen/MatrixFunctions>
+
+//Gain structures of ADMITTANCE: how M, D, K are stored and how M^-1 is applied
+
+//Six decoupled axes: gains are the diagonals, M^-1 is one reciprocal per axis
+struct DIAGONAL_GAINS {
+	typedef Eigen::Matrix<double,6,1> Gain;
+	typedef Eigen::Matrix<double,6,1> Vector6d;
+	struct INVERSE {
+		Eigen::Array<double,6,1> Minv;
+		void refresh(const Gain& M) {Minv = M.array().inverse();};
+	};
+	static Vector6d apply(const Gain& G, const Vector6d& x) {return G.cwiseProduct(x);};
+	//M^-1*(h - D*zd - K*z) with array operations only: six scalar second order systems in one pass
+	static Vector6d acceleration(const INVERSE& inv, const Gain& D, const Gain& K, const Vector6d& h, const Vector6d& zd, const Vector6d& z) {
+		return (inv.Minv*(h.array() - D.array()*zd.array() - K.array()*z.array())).matrix();
+	};
+	//Zero-order-hold transition of each axis: [z;zd]+ = P*[z;zd] + G*h
+	struct DISCRETE {
+		Eigen::Array<double,6,1> P11, P12, P21, P22, G1, G2;
+		void refresh(const Gain& M, const Gain& D, const Gain& K, double dt) {
+			for(int i=0; i<6; i++) {
+				//exp([A B; 0 0]*dt) = [P G; 0 1]
+				Eigen::Matrix3d Ab = Eigen::Matrix3d::Zero();
+				Ab(0,1) = 1;
+				Ab(1,0) = -K(i)/M(i);
+				Ab(1,1) = -D(i)/M(i);
+				Ab(1,2) = 1/M(i);
+				Eigen::Matrix3d E = (Ab*dt).exp();
+				P11(i) = E(0,0); P12(i) = E(0,1); G1(i) = E(0,2);
+				P21(i) = E(1,0); P22(i) = E(1,1); G2(i) = E(1,2);
+			}
+		};
+		//a + s*(b - a), element by element
+		void blend(const DISCRETE& a, const DISCRETE& b, double s) {
+			P11 = a.P11 + s*(b.P11 - a.P11); P12 = a.P12 + s*(b.P12 - a.P12); G1 = a.G1 + s*(b.G1 - a.G1);
+			P21 = a.P21 + s*(b.P21 - a.P21); P22 = a.P22 + s*(b.P22 - a.P22); G2 = a.G2 + s*(b.G2 - a.G2);
+		};
+		void step(const Vector6d& h, Vector6d& zd, Vector6d& z) const {
+			Eigen::Array<double,6,1> z0 = z.array(), zd0 = zd.array();
+			z = (P11*z0 + P12*zd0 + G1*h.array()).matrix();
+			zd = (P21*z0 + P22*zd0 + G2*h.array()).matrix();
+		};
+	};
+};
+
+//Coupled axes: symmetric positive definite gains, M^-1 through a cached Cholesky factorization
+struct FULL_GAINS {
+	typedef Eigen::Matrix<double,6,6> Gain;
+	typedef Eigen::Matrix<double,6,1> Vector6d;
+	struct INVERSE {
+		Eigen::LLT<Gain> llt;
+		void refresh(const Gain& M) {llt.compute(M);};
+	};
+	static Vector6d apply(const Gain& G, const Vector6d& x) {return G*x;};
+	static Vector6d acceleration(const INVERSE& inv, const Gain& D, const Gain& K, const Vector6d& h, const Vector6d& zd, const Vector6d& z) {
+		return inv.llt.solve(h - D*zd - K*z);
+	};
+	struct DISCRETE {
+		Eigen::Matrix<double,12,12> P;
+		Eigen::Matrix<double,12,6> G;
+		void refresh(const Gain& M, const Gain& D, const Gain& K, double dt) {
+			Eigen::LLT<Gain> llt(M);
+			Eigen::Matrix<double,18,18> Ab = Eigen::Matrix<double,18,18>::Zero();
+			Ab.block<6,6>(0,6).setIdentity();
+			Ab.block<6,6>(6,0) = -llt.solve(K);
+			Ab.block<6,6>(6,6) = -llt.solve(D);
+			Ab.block<6,6>(6,12) = llt.solve(Gain::Identity());
+			Eigen::Matrix<double,18,18> E = (Ab*dt).exp();
+			P = E.block<12,12>(0,0);
+			G = E.block<12,6>(0,12);
+		};
+		void blend(const DISCRETE& a, const DISCRETE& b, double s) {
+			P = a.P + s*(b.P - a.P);
+			G = a.G + s*(b.G - a.G);
+		};
+		void step(const Vector6d& h, Vector6d& zd, Vector6d& z) const {
+			Eigen::Matrix<double,12,1> x;
+			x << z, zd;
+			x = P*x + G*h;
+			z = x.head<6>();
+			zd = x.tail<6>();
+		};
+	};
+};
+
+enum ADMITTANCE_INTEGRATOR {EULER, ZOH};
+
+//Admittance model M*zdd + D*zd + K*z = h with the gain structure given by GAINS.
+//The factorization of M is refreshed only when M changes.
+//step() integrates with semi-implicit Euler or exactly for an input held over the sample time (ZOH):
+//the ZOH transition matrices are refreshed only when the gains or the sample time change.
+//On a gain ramp only its two ends are discretized, the samples in between interpolate their matrices
+template<class GAINS>
+class ADMITTANCE {
+	public:
+		typedef typename GAINS::Gain Gain;
+		typedef Eigen::Matrix<double,6,1> Vector6d;
+
+		ADMITTANCE(double dt=0.01, ADMITTANCE_INTEGRATOR integrator=ZOH) {
+			_M.setZero();
+			_D.setZero();
+			_K.setZero();
+			_valid=false;
+			_discrete=false;
+			_ramp=false;
+			_end0=_end1=false;
+			_s=0;
+			_dt=dt;
+			_integrator=integrator;
+		};
+		void setSampleTime(double dt) {
+			if(dt != _dt) _discrete = _end0 = _end1 = false;
+			_dt = dt;
+		};
+		void setIntegrator(ADMITTANCE_INTEGRATOR integrator) {_integrator=integrator;};
+		ADMITTANCE_INTEGRATOR getIntegrator() const {return _integrator;};
+		void setGains(const Gain& M, const Gain& D, const Gain& K) {
+			if(!_valid || M != _M) {
+				_M = M;
+				_inv.refresh(_M);
+				_valid = true;
+				_discrete = false;
+			}
+			if(D != _D || K != _K) _discrete = false;
+			_D = D;
+			_K = K;
+			if(_ramp) _discrete = false;
+			_ramp = false;
+		};
+		//Gains at s in [0,1] on the linear ramp from (M0,D0,K0) to (M1,D1,K1)
+		void setGains(const Gain& M0, const Gain& D0, const Gain& K0, const Gain& M1, const Gain& D1, const Gain& K1, double s) {
+			if(!_ramp || M0 != _M0 || D0 != _D0 || K0 != _K0) {
+				//A ramp usually starts where the previous one ended
+				bool shift = _ramp && _end1 && M0 == _M1 && D0 == _D1 && K0 == _K1;
+				if(shift) _zoh0 = _zoh1;
+				_end0 = shift;
+				_M0 = M0; _D0 = D0; _K0 = K0;
+			}
+			if(!_ramp || M1 != _M1 || D1 != _D1 || K1 != _K1) {
+				_end1 = false;
+				_M1 = M1; _D1 = D1; _K1 = K1;
+			}
+			Gain M = M0 + s*(M1 - M0);
+			if(!_valid || M != _M) {
+				_M = M;
+				_inv.refresh(_M);
+				_valid = true;
+			}
+			_D = D0 + s*(D1 - D0);
+			_K = K0 + s*(K1 - K0);
+			_s = s;
+			_ramp = true;
+		};
+		const Gain& getM() const {return _M;};
+		const Gain& getD() const {return _D;};
+		const Gain& getK() const {return _K;};
+
+		Vector6d acceleration(const Vector6d& h, const Vector6d& zd, const Vector6d& z) const {
+			return GAINS::acceleration(_inv, _D, _K, h, zd, z);
+		};
+		//One sample with h held: zd, z advanced, zdd the acceleration at the new state
+		void step(const Vector6d& h, Vector6d& zdd, Vector6d& zd, Vector6d& z) {
+			if(_integrator == EULER) {
+				zdd = acceleration(h, zd, z);
+				zd += zdd*_dt;
+				z += zd*_dt;
+				return;
+			}
+			if(_ramp) {
+				if(!_end0) _zoh0.refresh(_M0, _D0, _K0, _dt);
+				if(!_end1) _zoh1.refresh(_M1, _D1, _K1, _dt);
+				_end0 = _end1 = true;
+				_zoh.blend(_zoh0, _zoh1, _s);
+			}
+			else if(!_discrete) {
+				_zoh.refresh(_M, _D, _K, _dt);
+				_discrete = true;
+			}
+			_zoh.step(h, zd, z);
+			zdd = acceleration(h, zd, z);
+		};
+		//Stored energy 1/2 zd'M zd + 1/2 z'K z and dissipated power zd'D zd
+		double energy(const Vector6d& zd, const Vector6d& z) const {
+			return 0.5*zd.dot(GAINS::apply(_M,zd)) + 0.5*z.dot(GAINS::apply(_K,z));
+		};
+		double dissipation(const Vector6d& zd) const {return zd.dot(GAINS::apply(_D,zd));};
+
+	private:
+		Gain _M, _D, _K;
+		Gain _M0, _D0, _K0, _M1, _D1, _K1; //ramp ends
+		typename GAINS::INVERSE _inv;
+		typename GAINS::DISCRETE _zoh, _zoh0, _zoh1;
+		double _dt, _s;
+		ADMITTANCE_INTEGRATOR _integrator;
+		bool _valid, _discrete, _ramp, _end0, _end1;
+};
+
+#endif //_admittance_h_
@@ -0,0 +1,270 @@
+
+#ifndef _admittanceController_h_
+#define _admittanceController_h_
+
+#include "ros/ros.h"
+#include <ros/package.h>
+#include "boost/thread.hpp"
+#include "sensor_msgs/JointState.h"
+#include "geometry_msgs/PoseStamped.h"
+#include "geometry_msgs/TwistStamped.h"
+#include "geometry_msgs/AccelStamped.h"
+#include "gazebo_msgs/ContactsState.h"
+#include <std_msgs/Float64.h>
+#include <std_msgs/Float64MultiArray.h>
+#include <geometry_msgs/WrenchStamped.h>
+#include <geometry_msgs/PointStamped.h>
+
+#include <kdl_parser/kdl_parser.hpp>
+#include <kdl/chainfksolvervel_recursive.hpp>
+#include <kdl/chainfksolverpos_recursive.hpp>
+#include <kdl/chainiksolvervel_pinv.hpp>
+#include <kdl/chainfksolverpos_recursive.hpp>
+#include <kdl/chainiksolverpos_nr.hpp>
+#include <kdl/chainjnttojacsolver.hpp>
+#include <kdl/chainjnttojacdotsolver.hpp>
+
+#include "planner.h"
+#include <kuka_control/waypointsAction.h>
+#include <actionlib/server/simple_action_server.h>
+
+#include "filterBank.h"
+#include "energyTank.h"
+#include "admittance.h"
+#include "tickBudget.h"
+#include "asyncLog.h"
+#include "seqlock.h"
+#include "pose.h"
+#include "jointStateMap.h"
+#include "mailbox.h"
+#include "streamSpinner.h"
+#include "robotInterface.h"
+#include "decimator.h"
+#include "ftCalibration.h"
+#include "modelCache.h"
+#include "generatedKinematics.h"
+#include "armDynamics.h"
+#include "reachabilityMap.h"
+#include "distanceField.h"
+#include "linkCapsules.h"
+#include "selfCollision.h"
+
+class DERIV {
+	public:
+		DERIV(double freq=500,double gain=100) {_f=freq;_dt=1.0/_f;_integral=Eigen::VectorXd::Zero(6);_gain=gain;};
+		void update(Eigen::VectorXd x) {_xd=_gain*(x-_integral); _integral+=_gain*_dt*(x-_integral);};
+
+		Eigen::VectorXd _xd;
+	private:
+		double _f,_dt;
+		Eigen::VectorXd _integral;
+		double _gain;
+
+};
+
+enum diverterState {IMPACT, DETACHED, HOOKED, NORMAL};
+
+//Control loop state, written every tick for the supervisor
+struct LOOP_SNAPSHOT {
+	double z[6], zd[6], wrench[6];
+	double complPose[7], complVel[6], complAcc[6], desPose[7]; //position, quaternion x y z w
+	double admittanceEnergy, forcesEnergy, power;
+	double tankInput, tankDissipated; //stiffness tank port energy summed every tick since the start
+};
+
+//Arm state for the sensor callbacks, written by the control loop every tick after the forward kinematics
+struct ARM_SNAPSHOT {
+	double Re[9]; //end-effector rotation, column major
+	double qdNorm; //joint speed
+};
+
+//Contact wrench of the simulated sensor in the base frame, used by the control loop without an F/T sensor
+struct WRENCH_SNAPSHOT {
+	double w[6];
+};
+
+//Drone position feedback, from its own stream thread to the control loop
+struct DRONE_SNAPSHOT {
+	double p[3];
+};
+
+//Admittance gains scheduled by the supervisor: the control loop moves from the first to the second
+//set over one supervisor period
+struct GAIN_SNAPSHOT {
+	double M[2][6], D[2][6], K[2][6];
+	unsigned long tick;
+};
+
+class KUKA_INVDYN {
+	public:
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+		KUKA_INVDYN(ros::NodeHandle& nh, ros::NodeHandle& pnh, double sampleTime);
+		~KUKA_INVDYN() {stop();};
+		bool init(); //before run(): false when the controller cannot start
+		void run();
+		void stop();
+		bool mission_loop();
+		bool wait_for(double seconds);
+		bool init_robot_model();
+		void get_dirkin();
+
+		void interaction_wrench_cb(const gazebo_msgs::ContactsStateConstPtr&);
+		void real_interaction_wrench_cb(const geometry_msgs::WrenchStampedConstPtr&);
+		void drone_posfb_cb(const std_msgs::Float64MultiArrayConstPtr& message);
+		void ctrl_loop();
+		void supervisor_loop();
+		void compute_force_errors(const Eigen::VectorXd h, const Eigen::VectorXd hdot, const Eigen::VectorXd mask);
+		void compute_errors(const POSE& p_des, const geometry_msgs::TwistStamped& v_des, const geometry_msgs::AccelStamped& a_des);
+		void compute_compliantFrame(const POSE& p_des, const geometry_msgs::TwistStamped& v_des, const geometry_msgs::AccelStamped& a_des);
+		void compute_compliantFrame(const POSE& p_des, const geometry_msgs::TwistStamped& v_des, const geometry_msgs::AccelStamped& a_des, const std::vector<double> alpha);
+		bool newTrajectory(const std::vector<geometry_msgs::PoseStamped> waypoints, const std::vector<double> times);
+		bool newTrajectory(const std::vector<geometry_msgs::PoseStamped> waypoints, const std::vector<double> times, const Eigen::VectorXd xdi, const Eigen::VectorXd xdf, const Eigen::VectorXd xddi, const Eigen::VectorXd xddf);
+		bool newForceTrajectory(const std::vector<Eigen::VectorXd> waypoints, const std::vector<double> times, const Eigen::VectorXd mask);
+		bool getPose(geometry_msgs::PoseStamped& p_des);
+		bool getDesPose(geometry_msgs::PoseStamped& p_des);
+		bool getWrench(Eigen::VectorXd& _wrench);
+		bool robotReady() {return _first_fk;};
+		void exitForceControl() {_fControl=false;};
+		const diverterState getState() {return _state;};
+		void actionCB(const kuka_control::waypointsGoalConstPtr &goal);
+		void setDone(bool done) {_mainDone=done;};
+		void saveFtCalibration();
+		bool budgetFailed() {return _budgetFailed;};
+	private:
+		void updatePose();
+		void update_wrench(const ros::Time& tick);
+		void checkpoint_ft_calibration(double t, bool contact);
+		void updateForce();
+		void updateState(const Eigen::Matrix<double,6,1>& wrench, double dt);
+		void update_joint_states(const sensor_msgs::JointState& js);
+		void wait_joint_states();
+		void report_ingestion();
+		int seeded_ik(const KDL::Frame& F_dest, KDL::JntArray& q_out_new);
+		bool command_clear(const KDL::JntArray& q);
+		bool torque_command(const KDL::Frame& F_dest, bool hold, ARM_DYNAMICS::JointVector& tau);
+		ros::NodeHandle _nh;
+		ros::NodeHandle _pnh; //private namespace of the node or of the nodelet
+		boost::thread _ctrlThread, _supervisorThread;
+		volatile bool _stop;
+		ROBOT_MODEL _model;
+		std::string _modelName; //~model or iiwa_model
+		ARM_KINEMATICS _genKin; //generated for ~model, KDL solvers when not available
+		bool _useGenKin;
+		ros::WallTime _startTime; //cold start measurement
+		bool _firstCmd;
+
+		KDL::ChainFkSolverPos_recursive *_fksolver; //Forward position solver
+		KDL::ChainFkSolverVel_recursive *_fk_solver_pos_vel; //Forward position and velocity solver
+		KDL::ChainIkSolverVel_pinv *_ik_solver_vel;   	//Inverse velocity solver
+		KDL::ChainIkSolverPos_NR *_ik_solver_pos;
+		KDL::ChainJntToJacSolver *_J_solver;
+		KDL::ChainJntToJacDotSolver *_Jdot_solver;
+
+		KDL::Chain _k_chain;
+
+		JOINT_STATE_MAP _jsMap;
+		bool _mailbox; //latest-value ingestion of the state streams
+		STREAM_STATS _ftStats; //under _wrenchMutex, drops from the sequence numbers
+		unsigned int _ftSeq;
+		bool _ftSeqValid;
+		double _ingestionReport; //seconds between ingestion reports, 0: never
+		ros::Subscriber _wrench_sub, _real_wrench_sub, _dronePosFb_sub;
+		ros::Publisher _cartpose_pub, _cartvel_pub, _desPose_pub, _extWrench_pub, _linearDifference_pub, _linearVelDifference_pub;
+		ros::Publisher _plannedpose_pub,_plannedtwist_pub,_plannedacc_pub,_plannedwrench_pub;
+		ros::Publisher _robotEnergy_pub, _totalEnergy_pub, _tankEnergy_pub, _totalPower_pub, _kpvalue_pub, _kdvalue_pub;
+		KDL::JntArray *_initial_q;
+		KDL::JntArray *_q_in;
+		KDL::JntArray *_q_out;
+		KDL::JntArray *_q_in_old;
+		KDL::JntArray *_dq_in;
+		ros::Publisher _cmd_pub[7];
+		bool _first_js;
+		bool _first_fk;
+		bool _first_wrench;
+		KDL::FrameVel _dirkin_out;
+		KDL::Frame _p_out;
+		KDL::Twist _v_out;
+		ARM_DYNAMICS _dyn;
+		bool _torqueMode, _torqueGravity;
+		KDL::Frame _safeFrame; //last measured pose with the next configuration clear, held in torque mode
+		bool _safeFrameValid;
+		double _torqueKp, _torqueKd, _nullDamping;
+		double _dynBudget; //wall time allowed to the torque computation of one tick
+		int _budgetOverruns, _maxBudgetOverruns;
+		POSE _pose;
+		ros::Time _poseStamp;
+		geometry_msgs::TwistStamped _vel;
+		Eigen::VectorXd _acc;
+		Eigen::VectorXd x_t;
+		Eigen::VectorXd xDot_t;
+		Eigen::VectorXd xDotDot;
+		Eigen::MatrixXd _J;
+		Eigen::MatrixXd _Jold;
+		Eigen::MatrixXd _JDot;
+		Eigen::VectorXd _gradManMeas;
+		Eigen::VectorXd _extWrench;
+		Eigen::Matrix<double,6,1> _wrenchBias;
+		int _wrenchCount;
+		Eigen::Matrix3d _Re; //end-effector rotation and position cached by get_dirkin
+		Eigen::Vector3d _pe;
+		Eigen::VectorXd z_t,zDot_t,zDotDot_t;
+		POSE _complPose;
+		geometry_msgs::TwistStamped _complVel;
+		geometry_msgs::AccelStamped _complAcc;
+		POSE _desPose;
+		geometry_msgs::TwistStamped _desVel;
+		geometry_msgs::AccelStamped _desAcc;
+		bool _fControl;
+		bool _trajEnd;
+		bool _newPosReady;
+		POSE _nextdesPose;
+		geometry_msgs::TwistStamped _nextdesVel;
+		geometry_msgs::AccelStamped _nextdesAcc;
+		Eigen::Matrix<double,6,1> _Mt; //diagonal admittance gains, as interpolated by the control loop
+		Eigen::Matrix<double,6,1> _Kdt;
+		Eigen::Matrix<double,6,1> _Kpt;
+		ADMITTANCE<DIAGONAL_GAINS> _admittance;
+		Eigen::VectorXd xf,xf_dot,xf_dotdot;
+		Eigen::VectorXd _h_des,_hdot_des, _nexth_des,_nexthdot_des, _forceMask;
+		DERIV numericAcc;
+		double _sTime,_freq;
+		double _supervisorFreq; //state machine, gain scheduling, energy tank and telemetry
+		SEQLOCK<LOOP_SNAPSHOT> _loopSnapshot;
+		SEQLOCK<GAIN_SNAPSHOT> _gainSnapshot;
+		SEQLOCK<ARM_SNAPSHOT> _armSnapshot;
+		SEQLOCK<WRENCH_SNAPSHOT> _contactWrench;
+		SEQLOCK<DRONE_SNAPSHOT> _droneSnapshot;
+		TICK_BUDGET _tickTimes; //tick computation times, checked every _budgetCheckTicks ticks
+		int _budgetCheckTicks;
+		double _tickBudget, _budgetPercentile;
+		volatile bool _budgetFailed;
+		actionlib::SimpleActionServer<kuka_control::waypointsAction> _kukaActionServer;
+		kuka_control::waypointsFeedback _actionFeedback;
+  		kuka_control::waypointsResult _actionResult;
+		FILTER_BANK<6> _wrenchFilter;
+		POLYPHASE_DECIMATOR<6> _wrenchDecimator;
+		FT_CALIBRATION _ftCalib, _ftCalibPending, _ftCalibClean;
+		boost::mutex _ftCalibMutex; //_ftCalibClean, saved from other threads
+		std::string _ftCalibFile;
+		bool _ftRebias;
+		double _ftStaticVel, _ftForceGate, _ftTorqueGate, _ftSettleTime, _ftPendingTime;
+		std::atomic<bool> _ftFree; //NORMAL state and no contact building up, from the supervisor
+		boost::mutex _wrenchMutex;
+		FILTER_BANK<3> _dronePosFilter;
+		double _admittanceEnergy, _forcesEnergy, _contTime;
+		diverterState _state;
+		bool _firstCompliant, _mainDone;
+		REACHABILITY_MAP _reachMap;
+		KDL::Frame _lastF_dest;
+		bool _firstIk;
+		double _seedJumpTresh, _maxSeedStep;
+		DISTANCE_FIELD _sdf;
+		LINK_CAPSULES _capsules;
+		double _sdfClearance;
+		SELF_COLLISION _selfCollision;
+		bool _selfCollisionCheck;
+		STREAM_SPINNER _ftSpinner, _contactSpinner, _droneSpinner; //last: their threads stop first
+		boost::shared_ptr<ROBOT_INTERFACE> _robot; //joint states in, commands out
+};
+
+#endif //_admittanceController_h_
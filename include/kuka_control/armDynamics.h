@@ -0,0 +1,51 @@
+
+#ifndef _armDynamics_h_
+#define _armDynamics_h_
+
+#include <kdl/chain.hpp>
+#include <eigen3/Eigen/Dense>
+
+//Rigid body dynamics of a 7 joint revolute chain with fixed-size storage:
+//recursive Newton-Euler for gravity and Coriolis torques, composite rigid body algorithm for the inertia.
+//Links are expressed in joint frames (z on the axis), fixed segments are lumped into the link before them
+class ARM_DYNAMICS {
+	public:
+		enum {NJ=7};
+		typedef Eigen::Matrix<double,NJ,1> JointVector;
+		typedef Eigen::Matrix<double,NJ,NJ> JointMatrix;
+
+		ARM_DYNAMICS() {_ready=false;};
+		//gravity in the chain base frame
+		bool init(const KDL::Chain& chain, const Eigen::Vector3d& gravity=Eigen::Vector3d(0,0,-9.81));
+		bool isReady() const {return _ready;};
+
+		//M(q)*qdd + C(q,qd)*qd + g(q)
+		void inverseDynamics(const JointVector& q, const JointVector& qd, const JointVector& qdd, JointVector& tau) const;
+		void gravity(const JointVector& q, JointVector& g) const;
+		//C(q,qd)*qd
+		void coriolis(const JointVector& q, const JointVector& qd, JointVector& c) const;
+		void inertia(const JointVector& q, JointMatrix& M) const;
+		//All of the above with the joint rotations computed once: one control tick
+		void compute(const JointVector& q, const JointVector& qd, JointMatrix& M, JointVector& c, JointVector& g) const;
+
+	private:
+		struct LINK_STATE {
+			Eigen::Matrix3d R[NJ]; //frame i in frame i-1
+		};
+		void rotations(const JointVector& q, LINK_STATE& s) const;
+		void rnea(const LINK_STATE& s, const JointVector& qd, const JointVector& qdd, const Eigen::Vector3d& a0, JointVector& tau) const;
+		void crba(const LINK_STATE& s, JointMatrix& M) const;
+
+		//Chain rewritten as D[0]*Rz(s[0]*q0)*D[1]*...*Rz(s[6]*q6)
+		Eigen::Matrix3d _DR[NJ];
+		Eigen::Vector3d _Dp[NJ];
+		double _scale[NJ];
+		//Link inertia in its joint frame: mass, first moment, rotational inertia about the origin
+		double _mass[NJ];
+		Eigen::Vector3d _h[NJ];
+		Eigen::Matrix3d _I[NJ];
+		Eigen::Vector3d _gravity;
+		bool _ready;
+};
+
+#endif //_armDynamics_h_
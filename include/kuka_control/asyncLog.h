@@ -0,0 +1,65 @@
+
+#ifndef _asyncLog_h_
+#define _asyncLog_h_
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include "ros/ros.h"
+#include "boost/thread.hpp"
+
+//Log from the control and sensor threads without blocking on the terminal: the caller formats into
+//a fixed-size record of a lock-free ring, a background thread hands the records to rosconsole.
+//A full ring drops the record and counts it. Each call site has its own rate limit
+
+enum {ASYNC_LOG_TEXT = 200, ASYNC_LOG_RECORDS = 1024};
+
+//One per call site, static: the minimum interval between two records and the ones suppressed meanwhile
+struct ASYNC_LOG_SITE {
+	double period;
+	std::atomic<int64_t> next; //ns, monotonic
+	std::atomic<uint32_t> suppressed;
+};
+
+struct ASYNC_LOG_RECORD {
+	std::atomic<uint64_t> seq; //ring position the slot is ready for
+	ros::console::levels::Level level;
+	uint32_t suppressed;
+	char text[ASYNC_LOG_TEXT];
+};
+
+class ASYNC_LOG {
+	public:
+		//Created with its thread on the first use: call it once outside the real-time threads
+		static ASYNC_LOG& instance();
+		~ASYNC_LOG();
+		//False when rate limited or on a full ring
+		bool log(ASYNC_LOG_SITE& site, ros::console::levels::Level level, const char* fmt, ...) __attribute__((format(printf, 4, 5)));
+		uint64_t dropped() const {return _dropped.load(std::memory_order_relaxed);};
+		static int64_t now();
+	private:
+		ASYNC_LOG();
+		bool admit(ASYNC_LOG_SITE& site, uint32_t& suppressed);
+		ASYNC_LOG_RECORD* claim(uint64_t& pos);
+		bool drain();
+		void loop();
+		ASYNC_LOG_RECORD _ring[ASYNC_LOG_RECORDS];
+		alignas(64) std::atomic<uint64_t> _head; //next position claimed, producers
+		alignas(64) uint64_t _tail; //next position read, drain thread only
+		std::atomic<uint64_t> _dropped;
+		uint64_t _droppedReported; //drain thread only
+		volatile bool _stop;
+		boost::thread _thread;
+};
+
+//ALOG_WARN(period, fmt, ...): at most one record every period seconds from this call site, 0: all of them
+#define ALOG(level, period, ...) do { \
+		static ASYNC_LOG_SITE _alogSite = {period, {0}, {0}}; \
+		ASYNC_LOG::instance().log(_alogSite, level, __VA_ARGS__); \
+	} while(0)
+#define ALOG_DEBUG(period, ...) ALOG(ros::console::levels::Debug, period, __VA_ARGS__)
+#define ALOG_INFO(period, ...) ALOG(ros::console::levels::Info, period, __VA_ARGS__)
+#define ALOG_WARN(period, ...) ALOG(ros::console::levels::Warn, period, __VA_ARGS__)
+#define ALOG_ERROR(period, ...) ALOG(ros::console::levels::Error, period, __VA_ARGS__)
+
+#endif //_asyncLog_h_
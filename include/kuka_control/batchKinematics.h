@@ -0,0 +1,50 @@
+
+#ifndef _batchKinematics_h_
+#define _batchKinematics_h_
+
+#include <vector>
+#include <kdl/chain.hpp>
+#include <kdl/frames.hpp>
+#include <eigen3/Eigen/Dense>
+
+//Joint configurations in structure-of-arrays layout: joint j of configuration k is q[j*size + k]
+struct JOINT_BATCH {
+	JOINT_BATCH(int n_joints=0, int n=0) {resize(n_joints,n);};
+	void resize(int n_joints, int n) {nj=n_joints; size=n; q.assign(nj*size,0.0);};
+	double* joint(int j) {return &q[j*size];};
+	const double* joint(int j) const {return &q[j*size];};
+	int nj, size;
+	std::vector<double> q;
+};
+
+//Tip frames and Jacobians of a JOINT_BATCH, same layout.
+//p[i*size+k]: position i, R[(3*r+c)*size+k]: rotation (r,c), J[(6*j+r)*size+k]: Jacobian (r,j)
+//Jacobian is the KDL one: reference point on the tip, expressed in the base frame
+struct POSE_BATCH {
+	POSE_BATCH() {nj=0; size=0;};
+	void resize(int n_joints, int n) {nj=n_joints; size=n; p.resize(3*size); R.resize(9*size); J.resize(6*nj*size);};
+	KDL::Frame frame(int k) const;
+	void jacobian(int k, Eigen::Matrix<double,6,Eigen::Dynamic>& Jk) const;
+	int nj, size;
+	std::vector<double> p, R, J;
+};
+
+class BATCH_KINEMATICS {
+	public:
+		BATCH_KINEMATICS() {_nj=0;};
+		bool init(const KDL::Chain& chain);
+		//lanes: configurations per lane group (4 or 8), threads: worker threads splitting the batch
+		void compute(const JOINT_BATCH& q, POSE_BATCH& out, bool jacobian=true, int lanes=4, int threads=1) const;
+		int getNrOfJoints() const {return _nj;};
+	private:
+		void computeRange(const JOINT_BATCH& q, POSE_BATCH& out, bool jacobian, int lanes, int first, int last) const;
+		template<int L> void kernel(const JOINT_BATCH& q, POSE_BATCH& out, bool jacobian, int first) const;
+
+		enum {MAX_JOINTS=16};
+		//Chain rewritten as D[0]*Rz(s[0]*q0)*D[1]*Rz(s[1]*q1)*...*Rz(s[n-1]*qn-1)*D[n]
+		int _nj;
+		std::vector<KDL::Frame> _D;
+		std::vector<double> _scale;
+};
+
+#endif //_batchKinematics_h_
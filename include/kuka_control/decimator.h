@@ -0,0 +1,96 @@
+
+#ifndef _decimator_h_
+#define _decimator_h_
+
+#include <cmath>
+#include <vector>
+#include <eigen3/Eigen/Dense>
+#include "filterBank.h"
+
+//Anti-aliasing decimator for an N channel stream sampled at inputRate, read at arbitrary times.
+//A Butterworth pre-stage at the input rate does the anti-aliasing: minimum phase, so the delay is a
+//fraction of what a linear phase FIR with the same transition band needs. Its output is then
+//interpolated by a two tap polyphase filter: output(t) picks the phase matching the time elapsed since
+//the last sample, one input period behind t. Samples are assumed evenly spaced
+template<int N>
+class POLYPHASE_DECIMATOR {
+	public:
+		typedef Eigen::Matrix<double,N,1> Vector;
+
+		POLYPHASE_DECIMATOR() {_order=0; _phases=0; _inputRate=0; _delay=0; _nSamples=0; _lastStamp=0;};
+
+		//Pass band up to cutoff, stop band from stopband [Hz]; the order follows from the transition width.
+		//Designs whose low frequency delay exceeds maxDelay [s] are refused
+		bool init(double inputRate, double cutoff, double stopband, double maxDelay, int phases=32) {
+			if(inputRate<=0 || cutoff<=0 || stopband<=cutoff || stopband>inputRate/2.0 || maxDelay<=0 || phases<1) return false;
+
+			//Order for 40 dB at the stop band edge, on the prewarped band edges: a stop band at the input
+			//Nyquist frequency is a zero of the bilinear transform
+			double stopAttenuation = 40.0;
+			double K = tan(M_PI*cutoff/inputRate);
+			double ratio = tan(std::min(M_PI*stopband/inputRate, 0.5*M_PI - 1e-9))/K;
+			int order = std::max(1, (int)ceil(log10(pow(10.0, stopAttenuation/10.0) - 1.0)/(2.0*log10(ratio))));
+			if(order > 2*FILTER_BANK<N>::MAX_SECTIONS) return false;
+
+			//Butterworth group delay at DC, 1/sin(pi/2n) over the prewarped cutoff, and the interpolation lag
+			double delay = 1.0/(sin(M_PI/(2.0*order))*2.0*K*inputRate) + 1.0/inputRate;
+			if(delay > maxDelay) return false;
+
+			if(!_prestage.butterworth(order, 1.0/inputRate, cutoff)) return false;
+			_order = order;
+			_delay = delay;
+			_inputRate = inputRate;
+			_phases = phases;
+
+			//Phase p: linear interpolation at p/phases of the last input period, previous sample first
+			_h.resize(_phases);
+			for(int p=0; p<_phases; p++)
+				_h[p] << 1.0 - (double)p/_phases, (double)p/_phases;
+
+			_buffer.setZero();
+			_nSamples = 0;
+			return true;
+		};
+
+		void push(const Vector& x, double stamp) {
+			if(_order==0) return;
+			if(_nSamples==0) {
+				//Start from steady state on the first sample
+				_prestage.reset(x);
+				_buffer.col(1) = x;
+			}
+			_buffer.col(0) = _buffer.col(1);
+			_buffer.col(1) = _prestage.update(x);
+			_lastStamp = stamp;
+			_nSamples++;
+		};
+
+		//Filtered value at time t, false before the first sample
+		bool output(double t, Vector& y) const {
+			if(_nSamples==0) return false;
+			int p = (int)floor((t-_lastStamp)*_inputRate*_phases + 0.5);
+			p = std::max(0, std::min(_phases-1, p));
+			y.noalias() = _buffer*_h[p];
+			return true;
+		};
+
+		//Seconds since the last sample
+		double age(double t) const {return t-_lastStamp;};
+		//Low frequency delay: pre-stage group delay and one input period of interpolation
+		double getDelay() const {return _delay;};
+		int getOrder() const {return _order;};
+		long getNrOfSamples() const {return _nSamples;};
+
+	private:
+		int _order, _phases;
+		long _nSamples;
+		double _inputRate, _lastStamp, _delay;
+		FILTER_BANK<N> _prestage;
+		std::vector<Eigen::Vector2d> _h;
+		Eigen::Matrix<double,N,2> _buffer;
+
+	public:
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+#endif //_decimator_h_
@@ -0,0 +1,48 @@
+
+#ifndef _distanceField_h_
+#define _distanceField_h_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <eigen3/Eigen/Dense>
+
+//Signed distance grid of the work cell: positive in free space, negative inside forbidden regions.
+//File layout: SDF_HEADER followed by dims[0]*dims[1]*dims[2] floats, x-major (index (ix*dims[1]+iy)*dims[2]+iz)
+struct SDF_HEADER {
+	char magic[8];
+	uint32_t version;
+	uint32_t dims[3];
+	double origin[3];
+	double resolution;
+};
+
+class DISTANCE_FIELD {
+	public:
+		DISTANCE_FIELD();
+		~DISTANCE_FIELD();
+		void create(const double origin[3], double resolution, const uint32_t dims[3]);
+		float& at(uint32_t ix, uint32_t iy, uint32_t iz) {return _data[(ix*_header.dims[1]+iy)*_header.dims[2]+iz];};
+		Eigen::Vector3d cellCenter(uint32_t ix, uint32_t iy, uint32_t iz) const;
+		bool save(const std::string& file) const;
+		//Memory-maps a saved grid (read-only)
+		bool load(const std::string& file);
+		bool isLoaded() const {return _data!=NULL;};
+
+		//Trilinear interpolation, points outside the grid are clamped to its border
+		double distance(const Eigen::Vector3d& p, Eigen::Vector3d* gradient=NULL) const;
+		//Lower bound on the clearance of a capsule, sampled along its segment every quarter of a cell
+		double capsuleDistance(const Eigen::Vector3d& a, const Eigen::Vector3d& b, double radius) const;
+		//Moves p out along the gradient if it is closer than clearance; returns the correction, 0 if none.
+		//normal gets the unit outward direction used
+		double projectOut(Eigen::Vector3d& p, double clearance, Eigen::Vector3d* normal=NULL) const;
+	private:
+		void unload();
+		SDF_HEADER _header;
+		std::vector<float> _storage;
+		void* _mapped;
+		size_t _mappedSize;
+		float* _data;
+};
+
+#endif //_distanceField_h_
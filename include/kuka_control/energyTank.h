@@ -0,0 +1,59 @@
+
+#ifndef _energyTank_h_
+#define _energyTank_h_
+
+#include <cmath>
+#include <eigen3/Eigen/Dense>
+
+//Energy tank guarding N power ports.
+//STORES is 1 for one tank shared by the ports, N for one tank per port (e.g. per Cartesian axis).
+//Each port i draws power[i] (positive: energy taken from the tank) scaled by alpha[i], which goes to 0
+//as its tank empties; dissipation[i] is the power dissipated on port i, partly given back to its tank.
+template<int N, int STORES=1>
+class ENERGY_TANK {
+	public:
+		static_assert(STORES == 1 || STORES == N, "one shared tank or one tank per port");
+		typedef Eigen::Array<double,N,1> Ports;
+		typedef Eigen::Array<double,STORES,1> Stores;
+
+		ENERGY_TANK(double Einit=1.0, double Emin=0.01, double Emax=1.0, double dt=0.001, double eta=0.8) {
+			init(Einit,Emin,Emax,dt,eta);
+		};
+		void init(double Einit, double Emin, double Emax, double dt, double eta=0.8) {
+			_Emin = Emin;
+			_Emax = Emax;
+			_xtMax = sqrt(2*Emax);
+			_dt = dt;
+			_eta = eta;
+			_xt.setConstant(sqrt(2*Einit));
+			_Et.setConstant(Einit);
+			_alpha.setOnes();
+		};
+
+		void update(const Ports& power, const Ports& dissipation) {
+			Stores f = 0.5*(1 - (M_PI*(_Et-_Emin)/(_Emax-_Emin)).cos());
+			Stores drawn = Stores::Zero(), diss = Stores::Zero();
+			for(int i=0; i<N; i++) {
+				const int s = (STORES == 1) ? 0 : i;
+				_alpha(i) = (power(i) > 0) ? f(s) : 1.0;
+				drawn(s) += (_Et(s) >= _Emin && power(i) >= 0) ? _alpha(i)*power(i) : 0.0;
+				diss(s) += dissipation(i);
+			}
+			Stores beta = (_Et <= _Emax).template cast<double>();
+			_xt += _dt*(beta*_eta*diss - drawn)/_xt;
+			_xt = _xt.min(_xtMax);
+			_Et = 0.5*_xt.square();
+		};
+
+		const Ports& getAlpha() const {return _alpha;};
+		double getAlpha(int i) const {return _alpha(i);};
+		const Stores& getEnergies() const {return _Et;};
+		double getEt() const {return _Et.sum();};
+
+	private:
+		Ports _alpha;
+		Stores _xt, _Et;
+		double _Emin, _Emax, _xtMax, _dt, _eta;
+};
+
+#endif //_energyTank_h_
@@ -0,0 +1,94 @@
+
+#ifndef _filterBank_h_
+#define _filterBank_h_
+
+#include <cmath>
+#include <eigen3/Eigen/Dense>
+
+//N channels filtered in lockstep by the same low pass: a cascade of biquad sections
+//(transposed direct form II) whose coefficients are computed once, when the filter is configured.
+//Channel states are Eigen arrays, so each section is a few vector operations over all channels
+template<int N>
+class FILTER_BANK {
+	public:
+		static const int MAX_SECTIONS = 4;
+		typedef Eigen::Matrix<double,N,1> Vector;
+
+		FILTER_BANK() {
+			_nSections = 0;
+			_out.setZero();
+		};
+
+		//First-order low pass y += (x-y)*(1-exp(-2*pi*fc*dt)), as LowPassFilter
+		void firstOrder(double dt, double cutoffFrequency) {
+			double ePow = (dt>0 && cutoffFrequency>0) ? 1.0-exp(-dt*2.0*M_PI*cutoffFrequency) : 0.0;
+			_nSections = 1;
+			_sec[0].set(ePow, 0, 0, -(1.0-ePow), 0);
+			reset(_out);
+		};
+
+		//Butterworth low pass of order 1..2*MAX_SECTIONS (bilinear transform, prewarped cutoff)
+		bool butterworth(int order, double dt, double cutoffFrequency) {
+			if(order<1 || order>2*MAX_SECTIONS || dt<=0 || cutoffFrequency<=0 || cutoffFrequency>=0.5/dt) return false;
+
+			double K = tan(M_PI*cutoffFrequency*dt);
+			_nSections = 0;
+			for(int k=0; k<order/2; k++) {
+				//Pole pair at pi*(order-1-2k)/(2*order) from the negative real axis
+				double Q = 1.0/(2.0*cos(M_PI*(order-1-2*k)/(2.0*order)));
+				double norm = 1.0/(1.0 + K/Q + K*K);
+				double b0 = K*K*norm;
+				_sec[_nSections++].set(b0, 2.0*b0, b0, 2.0*(K*K-1.0)*norm, (1.0 - K/Q + K*K)*norm);
+			}
+			if(order%2) {
+				double b0 = K/(K+1.0);
+				_sec[_nSections++].set(b0, b0, 0, (K-1.0)/(K+1.0), 0);
+			}
+			reset(_out);
+			return true;
+		};
+
+		//Steady state on x (all sections have unit DC gain)
+		void reset(const Vector& x) {
+			for(int s=0; s<_nSections; s++) {
+				_sec[s].z1 = x.array()*(1.0 - _sec[s].b0);
+				_sec[s].z2 = x.array()*(_sec[s].b2 - _sec[s].a2);
+			}
+			_out = x;
+		};
+
+		const Vector& update(const Vector& x) {
+			Eigen::Array<double,N,1> v = x.array();
+			for(int s=0; s<_nSections; s++) {
+				SECTION& c = _sec[s];
+				Eigen::Array<double,N,1> y = c.b0*v + c.z1;
+				c.z1 = c.b1*v - c.a1*y + c.z2;
+				c.z2 = c.b2*v - c.a2*y;
+				v = y;
+			}
+			_out = v.matrix();
+			return _out;
+		};
+
+		const Vector& getOutput() const {return _out;};
+		int getNrOfSections() const {return _nSections;};
+
+	private:
+		struct SECTION {
+			double b0, b1, b2, a1, a2;
+			Eigen::Array<double,N,1> z1, z2;
+			void set(double ib0, double ib1, double ib2, double ia1, double ia2) {
+				b0 = ib0; b1 = ib1; b2 = ib2; a1 = ia1; a2 = ia2;
+				z1.setZero();
+				z2.setZero();
+			};
+		};
+		SECTION _sec[MAX_SECTIONS];
+		int _nSections;
+		Vector _out;
+
+	public:
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+#endif //_filterBank_h_
@@ -0,0 +1,65 @@
+
+#ifndef _friShm_h_
+#define _friShm_h_
+
+#include <string>
+#include <cstdint>
+#include "latestSlot.h"
+
+//Joint commands and measured states between the controller and the FRI bridge through a POSIX
+//shared memory segment. The bridge creates the segment, the controller opens it. No ROS dependency:
+//the bridge links the kuka_fri_shm library only. Stamps are CLOCK_MONOTONIC nanoseconds
+
+enum {FRI_SHM_JOINTS = 7};
+enum FRI_SHM_MODE {SHM_POSITION = 0, SHM_TORQUE = 1};
+
+struct SHM_JOINT_COMMAND {
+	uint64_t stamp, seq;
+	uint32_t mode; //FRI_SHM_MODE, in torque mode q holds the measured configuration
+	uint32_t pad;
+	double q[FRI_SHM_JOINTS], tau[FRI_SHM_JOINTS];
+};
+
+struct SHM_JOINT_STATE {
+	uint64_t stamp, seq;
+	double q[FRI_SHM_JOINTS], qd[FRI_SHM_JOINTS], tau[FRI_SHM_JOINTS];
+};
+
+struct FRI_SHM_SEGMENT {
+	enum {MAGIC = 0x4b465249, VERSION = 2};
+	std::atomic<uint32_t> magic; //set last by the creator
+	uint32_t version;
+	LATEST_SLOT<SHM_JOINT_COMMAND> commands; //controller to bridge
+	LATEST_SLOT<SHM_JOINT_STATE> states; //bridge to controller
+};
+
+class FRI_SHM {
+	public:
+		FRI_SHM();
+		~FRI_SHM() {close();};
+		//Bridge side: a new segment, replacing the one of a previous run
+		bool create(const std::string& name);
+		//Controller side: the segment of a running bridge, false until it has been created
+		bool open(const std::string& name);
+		void close();
+		bool isOpen() const {return _seg != 0;};
+
+		//Controller side. sendCommand stamps and numbers the command
+		bool sendCommand(SHM_JOINT_COMMAND& c);
+		bool latestState(SHM_JOINT_STATE& s, unsigned long* skipped = 0);
+		//Bridge side. sendState stamps and numbers the state
+		bool latestCommand(SHM_JOINT_COMMAND& c, unsigned long* skipped = 0);
+		bool sendState(SHM_JOINT_STATE& s);
+
+		//Overwritten before the other side read them
+		uint64_t commandsSkipped() const {return _seg ? _seg->commands.skipped.load() : 0;};
+		uint64_t statesSkipped() const {return _seg ? _seg->states.skipped.load() : 0;};
+		static uint64_t now();
+	private:
+		FRI_SHM_SEGMENT* _seg;
+		std::string _name;
+		bool _owner;
+		uint64_t _cmdSeq, _stateSeq;
+};
+
+#endif //_friShm_h_
@@ -0,0 +1,48 @@
+
+#ifndef _ftCalibration_h_
+#define _ftCalibration_h_
+
+#include <string>
+#include <eigen3/Eigen/Dense>
+
+//F/T sensor offsets and tool payload, in the sensor frame, estimated by recursive least squares.
+//With g the gravity vector in the sensor frame, a contact-free measurement is
+//  f = b_f + m*g                    theta_f = [b_f; m]
+//  t = b_t + (m*c) x g              theta_t = [b_t; m*c]
+class FT_CALIBRATION {
+	public:
+		typedef Eigen::Matrix<double,6,1> Vector6d;
+
+		FT_CALIBRATION();
+		//Offsets only (tool weight folded in), with an uninformed payload
+		void reset(const Vector6d& bias);
+		//Forgetting factor of the RLS updates, per sample
+		void setForgetting(double lambda) {_lambda = lambda;};
+
+		//Gravity and offset load expected at the sensor for gravity g (sensor frame)
+		Vector6d predict(const Eigen::Vector3d& g) const;
+		//RLS step with a contact-free measurement w. Samples further than forceGate/torqueGate from the
+		//prediction are taken as contacts and skipped (returns false); until the estimate is trusted the
+		//gates are widened by the uncertainty of the prediction at g
+		bool update(const Vector6d& w, const Eigen::Vector3d& g, double forceGate, double torqueGate);
+
+		//Text file: bias_force, bias_torque, mass, mass_com lines
+		bool save(const std::string& file) const;
+		bool load(const std::string& file);
+
+		bool isValid() const {return _valid;};
+		//Payload observed from enough orientations (or loaded from file)
+		bool isTrusted() const {return _trusted;};
+		double mass() const {return _thetaF(3);};
+		Eigen::Vector3d com() const;
+
+	private:
+		Eigen::Matrix<double,4,1> _thetaF;
+		Eigen::Matrix<double,4,4> _PF;
+		Vector6d _thetaT;
+		Eigen::Matrix<double,6,6> _PT;
+		double _lambda;
+		bool _valid, _trusted;
+};
+
+#endif //_ftCalibration_h_
@@ -0,0 +1,46 @@
+
+#ifndef _generatedKinematics_h_
+#define _generatedKinematics_h_
+
+#include <cmath>
+#include <string>
+#include <eigen3/Eigen/Dense>
+
+//Arm models with kinematics generated at build time by scripts/generate_kinematics.py
+enum ARM_MODEL {IIWA7, IIWA14};
+
+//Specialized per model in the generated <model>Kinematics.h headers
+template<int MODEL>
+struct GENERATED_KINEMATICS;
+
+#include "iiwa7Kinematics.h"
+#include "iiwa14Kinematics.h"
+
+//Generated kinematics picked at run time by model name: one indirect call per control tick
+struct ARM_KINEMATICS {
+	typedef Eigen::Matrix<double,6,7> Jacobian;
+	void (*fk)(const double* q, Eigen::Matrix3d& R, Eigen::Vector3d& p);
+	void (*compute)(const double* q, const double* qd, Eigen::Matrix3d& R, Eigen::Vector3d& p, Jacobian& J, Jacobian& Jdot);
+	const char* base;
+	const char* tip;
+
+	ARM_KINEMATICS() {fk=NULL; compute=NULL; base=NULL; tip=NULL;};
+	bool select(const std::string& model) {
+		if(model == "iiwa7") return set<IIWA7>();
+		if(model == "iiwa14") return set<IIWA14>();
+		return false;
+	};
+
+	private:
+		template<int MODEL>
+		bool set() {
+			static_assert(GENERATED_KINEMATICS<MODEL>::NJ == 7, "ARM_KINEMATICS handles 7 joint arms");
+			fk = &GENERATED_KINEMATICS<MODEL>::fk;
+			compute = &GENERATED_KINEMATICS<MODEL>::compute;
+			base = GENERATED_KINEMATICS<MODEL>::BASE;
+			tip = GENERATED_KINEMATICS<MODEL>::TIP;
+			return true;
+		};
+};
+
+#endif //_generatedKinematics_h_
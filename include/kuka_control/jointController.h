@@ -0,0 +1,39 @@
+
+#ifndef _jointController_h_
+#define _jointController_h_
+
+#include "ros/ros.h"
+#include "boost/thread.hpp"
+#include "sensor_msgs/JointState.h"
+#include <std_msgs/Float64MultiArray.h>
+
+#include <kdl/jntarray.hpp>
+
+#include "jointStateMap.h"
+#include "asyncLog.h"
+
+class KUKA_CONTROL {
+	public:
+		KUKA_CONTROL(ros::NodeHandle& nh, ros::NodeHandle& pnh);
+		~KUKA_CONTROL() {stop();};
+		void run();
+		void stop();
+		void joint_states_cb( const sensor_msgs::JointStateConstPtr& );
+		void ctrl_loop();
+
+	private:
+		ros::NodeHandle _nh;
+		ros::Subscriber _js_sub;
+		JOINT_STATE_MAP _jsMap;
+		ros::Publisher _js_pub;
+		bool _first_js;
+		KDL::JntArray *_q_in;
+		KDL::JntArray *_dq_in;
+		bool _sync;
+		double _sTime;
+		boost::thread _ctrlThread;
+		volatile bool _stop;
+
+};
+
+#endif //_jointController_h_
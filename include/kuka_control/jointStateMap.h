@@ -0,0 +1,68 @@
+
+#ifndef _jointStateMap_h_
+#define _jointStateMap_h_
+
+#include <string>
+#include <vector>
+#include "sensor_msgs/JointState.h"
+
+//Chain joint i is entry index(i) of the joint_states messages. The cached indexes are used when the names
+//at them match, otherwise the names are resolved again, so other joints (grippers, other arms) may share the
+//topic. Messages without the chain joints are skipped and keep the cache. Messages without names are taken
+//in chain order
+class JOINT_STATE_MAP {
+	public:
+		JOINT_STATE_MAP() {_ready=false;};
+		void setJointNames(const std::vector<std::string>& names) {
+			_names = names;
+			_index.assign(names.size(), -1);
+			_ready = false;
+		};
+		//True when the cached indexes hold the chain joints of this message
+		bool matches(const sensor_msgs::JointState& js) const {
+			if(!_ready || js.name.empty() != _unnamed) return false;
+			for(size_t i=0; i<_names.size(); i++)
+				if(_index[i] >= (int)js.position.size() || (!_unnamed && (_index[i] >= (int)js.name.size() || js.name[_index[i]] != _names[i])))
+					return false;
+			return true;
+		};
+		//False, with the cache unchanged, while a chain joint is missing from the message
+		bool resolve(const sensor_msgs::JointState& js) {
+			std::vector<int> index(_names.size(), -1);
+			for(size_t i=0; i<_names.size(); i++) {
+				if(js.name.empty())
+					index[i] = i;
+				else
+					for(size_t k=0; k<js.name.size(); k++)
+						if(js.name[k] == _names[i]) {
+							index[i] = k;
+							break;
+						}
+				if(index[i] < 0 || index[i] >= (int)js.position.size()) return false;
+			}
+			_index.swap(index);
+			_unnamed = js.name.empty();
+			_ready = true;
+			return true;
+		};
+		//Positions and velocities in chain order; velocities are zero when the message has none
+		bool gather(const sensor_msgs::JointState& js, double* q, double* qd) {
+			if(!matches(js) && !resolve(js)) return false;
+			bool vel = (js.velocity.size() == js.position.size());
+			for(size_t i=0; i<_index.size(); i++) {
+				q[i] = js.position[_index[i]];
+				qd[i] = vel ? js.velocity[_index[i]] : 0.0;
+			}
+			return true;
+		};
+		bool ready() const {return _ready;};
+		int size() const {return _names.size();};
+		int index(int i) const {return _index[i];};
+	private:
+		std::vector<std::string> _names;
+		std::vector<int> _index;
+		bool _unnamed; //resolved on a message without names
+		bool _ready;
+};
+
+#endif //_jointStateMap_h_
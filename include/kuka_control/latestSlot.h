@@ -0,0 +1,58 @@
+
+#ifndef _latestSlot_h_
+#define _latestSlot_h_
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+//Latest value from one producer to one consumer without locks, usable from shared memory:
+//plain data and lock-free atomics only. A seqlocked slot: the producer overwrites the unread
+//value and never waits, the consumer always gets the newest one and counts the overwritten ones
+template<class T>
+struct LATEST_SLOT {
+	static_assert(std::is_trivially_copyable<T>::value, "slot values are copied as plain memory");
+	static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared slot counters must be lock-free");
+
+	alignas(64) std::atomic<uint64_t> seq; //twice the writes, odd during a write, producer only
+	alignas(64) std::atomic<uint64_t> read; //writes seen, consumer only
+	std::atomic<uint64_t> skipped; //writes overwritten before the consumer saw them
+	T data;
+
+	void init() {
+		seq.store(0, std::memory_order_relaxed);
+		read.store(0, std::memory_order_relaxed);
+		skipped.store(0, std::memory_order_relaxed);
+	};
+	//A new consumer starts from the next write, not from the value left by the previous one
+	void attach() {
+		read.store(seq.load(std::memory_order_acquire)/2, std::memory_order_relaxed);
+	};
+	void write(const T& v) {
+		uint64_t s = seq.load(std::memory_order_relaxed);
+		seq.store(s+1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		memcpy(&data, &v, sizeof(T));
+		seq.store(s+2, std::memory_order_release);
+	};
+	//False when nothing was written since the last call
+	bool latest(T& v, unsigned long* skip = 0) {
+		uint64_t r = read.load(std::memory_order_relaxed);
+		if(seq.load(std::memory_order_acquire)/2 == r) return false;
+		uint64_t s0, s1;
+		do {
+			s0 = seq.load(std::memory_order_acquire);
+			memcpy(&v, &data, sizeof(T));
+			std::atomic_thread_fence(std::memory_order_acquire);
+			s1 = seq.load(std::memory_order_relaxed);
+		} while((s0 & 1) || s0 != s1);
+		uint64_t n = s0/2 - r - 1;
+		if(skip) *skip += n;
+		skipped.fetch_add(n, std::memory_order_relaxed);
+		read.store(s0/2, std::memory_order_relaxed);
+		return true;
+	};
+};
+
+#endif //_latestSlot_h_
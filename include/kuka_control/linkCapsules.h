@@ -0,0 +1,46 @@
+
+#ifndef _linkCapsules_h_
+#define _linkCapsules_h_
+
+#include <string>
+#include <vector>
+#include <kdl/chain.hpp>
+#include <kdl/jntarray.hpp>
+#include <eigen3/Eigen/Dense>
+
+//Capsule (segment a-b swept by a sphere of radius r) attached to a link frame
+struct LINK_CAPSULE {
+	std::string link;
+	Eigen::Vector3d a, b;
+	double radius;
+};
+
+//Approximate capsules around iiwa7 iiwa_link_0 ... iiwa_link_7 (joint origin to next joint origin), in the link frames
+std::vector<LINK_CAPSULE> iiwa7Capsules();
+//Same for the iiwa14 (longer links, joint 5 and 7 without the iiwa7 offsets)
+std::vector<LINK_CAPSULE> iiwa14Capsules();
+//Capsules of a model by name (iiwa7, iiwa14); false when there are none
+bool modelCapsules(const std::string& model, std::vector<LINK_CAPSULE>& capsules);
+
+//Capsules of a chain moved to the base frame for a joint configuration
+class LINK_CAPSULES {
+	public:
+		LINK_CAPSULES() {_n=0;};
+		//False, and no capsules, if a capsule link is neither the chain root (base_link) nor one of its segments
+		bool init(const KDL::Chain& chain, const std::string& base_link, const std::vector<LINK_CAPSULE>& capsules);
+		//One pass over the chain
+		void update(const KDL::JntArray& q);
+		int size() const {return _n;};
+		const LINK_CAPSULE& capsule(int i) const {return _capsules[i];};
+		const Eigen::Vector3d& a(int i) const {return _a[i];};
+		const Eigen::Vector3d& b(int i) const {return _b[i];};
+		double radius(int i) const {return _capsules[i].radius;};
+	private:
+		KDL::Chain _chain;
+		std::vector<LINK_CAPSULE> _capsules;
+		std::vector<int> _frame; //number of chain segments before the capsule link frame
+		std::vector<Eigen::Vector3d> _a, _b;
+		int _n;
+};
+
+#endif //_linkCapsules_h_
@@ -0,0 +1,59 @@
+
+#ifndef _mailbox_h_
+#define _mailbox_h_
+
+#include <algorithm>
+#include "ros/ros.h"
+#include "boost/thread.hpp"
+#include "boost/shared_ptr.hpp"
+
+//Ingestion counters of a sensor stream: samples received, samples lost before use and
+//their age (seconds) when the consumer got them
+struct STREAM_STATS {
+	unsigned long received, dropped, taken;
+	double maxAge, sumAge;
+	STREAM_STATS() {reset();};
+	void reset() {received=0; dropped=0; taken=0; maxAge=0; sumAge=0;};
+	void sample(double age) {taken++; sumAge+=age; maxAge=std::max(maxAge,age);};
+	double meanAge() const {return taken ? sumAge/taken : 0.0;};
+};
+
+//Latest-value slot between a subscription callback and the control thread: a new message
+//replaces the unread one, so the consumer never works through a backlog of stale samples
+template<class MSG>
+class MAILBOX {
+	public:
+		typedef boost::shared_ptr<const MSG> MsgPtr;
+		void post(const MsgPtr& msg) {
+			boost::mutex::scoped_lock lock(_mutex);
+			if(_msg) _stats.dropped++;
+			_msg = msg;
+			_posted = ros::WallTime::now();
+			_stats.received++;
+		};
+		//Empty pointer when nothing arrived since the last take; age: seconds since the post
+		MsgPtr take(double& age) {
+			boost::mutex::scoped_lock lock(_mutex);
+			MsgPtr msg;
+			msg.swap(_msg);
+			if(msg) {
+				age = (ros::WallTime::now() - _posted).toSec();
+				_stats.sample(age);
+			}
+			return msg;
+		};
+		//Counters since the previous call
+		STREAM_STATS stats() {
+			boost::mutex::scoped_lock lock(_mutex);
+			STREAM_STATS s = _stats;
+			_stats.reset();
+			return s;
+		};
+	private:
+		boost::mutex _mutex;
+		MsgPtr _msg;
+		ros::WallTime _posted;
+		STREAM_STATS _stats;
+};
+
+#endif //_mailbox_h_
@@ -0,0 +1,61 @@
+
+#ifndef _modelCache_h_
+#define _modelCache_h_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <kdl/chain.hpp>
+
+//Compact binary copy of a base->tip chain, keyed by a hash of the URDF text and of the chain ends.
+//File layout: MODEL_CACHE_HEADER followed by nSegments MODEL_CACHE_SEGMENT records
+struct MODEL_CACHE_HEADER {
+	char magic[8];
+	uint32_t version;
+	uint32_t nSegments;
+	uint64_t hash;
+};
+
+struct MODEL_CACHE_SEGMENT {
+	char name[64];
+	char joint[64];
+	int32_t revolute; //0: fixed
+	int32_t pad;
+	double origin[3], axis[3]; //joint, parent frame
+	double tip[12];            //frame to tip at q=0: rotation (row-major), position
+	double mass, cog[3];
+	double inertia[6];         //about the COG: xx yy zz xy xz yz
+	double lower, upper, velocity, effort;
+};
+
+class ROBOT_MODEL {
+	public:
+		ROBOT_MODEL() {_fromCache=false;};
+		//Chain base->tip of urdf: memory-mapped from cacheDir when a cache with the same hash exists,
+		//otherwise parsed and written there for the next start
+		bool init(const std::string& urdf, const std::string& base, const std::string& tip, const std::string& cacheDir);
+		const KDL::Chain& chain() const {return _chain;};
+		bool fromCache() const {return _fromCache;};
+		const std::string& cacheFile() const {return _cacheFile;};
+		const std::vector<std::string>& jointNames() const {return _jointNames;};
+		const std::vector<double>& lower() const {return _lower;};
+		const std::vector<double>& upper() const {return _upper;};
+		const std::vector<double>& velocity() const {return _velocity;};
+		const std::vector<double>& effort() const {return _effort;};
+		//FNV-1a
+		static uint64_t hash(const std::string& data);
+		//Of the chain geometry: joint types, axes and segment frames at q=0, to 1e-6
+		static uint64_t chainHash(const KDL::Chain& chain);
+	private:
+		bool load(const std::string& file, uint64_t hash);
+		bool parse(const std::string& urdf, const std::string& base, const std::string& tip);
+		bool save(const std::string& file, uint64_t hash) const;
+		KDL::Chain _chain;
+		std::vector<MODEL_CACHE_SEGMENT> _segments;
+		std::vector<std::string> _jointNames;
+		std::vector<double> _lower, _upper, _velocity, _effort;
+		std::string _cacheFile;
+		bool _fromCache;
+};
+
+#endif //_modelCache_h_
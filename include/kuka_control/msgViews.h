@@ -0,0 +1,46 @@
+
+#ifndef _msgViews_h_
+#define _msgViews_h_
+
+#include <cstddef>
+#include <type_traits>
+#include <eigen3/Eigen/Dense>
+#include <eigen3/Eigen/Geometry>
+#include "geometry_msgs/Point.h"
+#include "geometry_msgs/Quaternion.h"
+#include "geometry_msgs/Vector3.h"
+#include "geometry_msgs/Twist.h"
+#include "geometry_msgs/Accel.h"
+#include "geometry_msgs/Wrench.h"
+
+//Eigen views over the double fields of geometry_msgs: a message is read or written as a vector in place.
+//The generated structs store their fields as consecutive doubles, the build fails here if they stop doing so
+
+static_assert(std::is_standard_layout<geometry_msgs::Vector3>::value && sizeof(geometry_msgs::Vector3) == 3*sizeof(double), "geometry_msgs::Vector3 is not three packed doubles");
+static_assert(std::is_standard_layout<geometry_msgs::Point>::value && sizeof(geometry_msgs::Point) == 3*sizeof(double), "geometry_msgs::Point is not three packed doubles");
+static_assert(std::is_standard_layout<geometry_msgs::Quaternion>::value && sizeof(geometry_msgs::Quaternion) == 4*sizeof(double) && offsetof(geometry_msgs::Quaternion, w) == 3*sizeof(double), "geometry_msgs::Quaternion is not x y z w packed doubles");
+static_assert(std::is_standard_layout<geometry_msgs::Twist>::value && offsetof(geometry_msgs::Twist, angular) == 3*sizeof(double) && sizeof(geometry_msgs::Twist) == 6*sizeof(double), "geometry_msgs::Twist is not six packed doubles");
+static_assert(std::is_standard_layout<geometry_msgs::Accel>::value && offsetof(geometry_msgs::Accel, angular) == 3*sizeof(double) && sizeof(geometry_msgs::Accel) == 6*sizeof(double), "geometry_msgs::Accel is not six packed doubles");
+static_assert(std::is_standard_layout<geometry_msgs::Wrench>::value && offsetof(geometry_msgs::Wrench, torque) == 3*sizeof(double) && sizeof(geometry_msgs::Wrench) == 6*sizeof(double), "geometry_msgs::Wrench is not six packed doubles");
+
+typedef Eigen::Map<Eigen::Matrix<double,6,1> > MsgVector6;
+typedef Eigen::Map<const Eigen::Matrix<double,6,1> > ConstMsgVector6;
+
+//Linear part first, as in the twist/accel/wrench vectors of the controller
+inline MsgVector6 vectorView(geometry_msgs::Twist& m) {return MsgVector6(&m.linear.x);}
+inline ConstMsgVector6 vectorView(const geometry_msgs::Twist& m) {return ConstMsgVector6(&m.linear.x);}
+inline MsgVector6 vectorView(geometry_msgs::Accel& m) {return MsgVector6(&m.linear.x);}
+inline ConstMsgVector6 vectorView(const geometry_msgs::Accel& m) {return ConstMsgVector6(&m.linear.x);}
+inline MsgVector6 vectorView(geometry_msgs::Wrench& m) {return MsgVector6(&m.force.x);}
+inline ConstMsgVector6 vectorView(const geometry_msgs::Wrench& m) {return ConstMsgVector6(&m.force.x);}
+
+inline Eigen::Map<Eigen::Vector3d> vectorView(geometry_msgs::Vector3& m) {return Eigen::Map<Eigen::Vector3d>(&m.x);}
+inline Eigen::Map<const Eigen::Vector3d> vectorView(const geometry_msgs::Vector3& m) {return Eigen::Map<const Eigen::Vector3d>(&m.x);}
+inline Eigen::Map<Eigen::Vector3d> vectorView(geometry_msgs::Point& m) {return Eigen::Map<Eigen::Vector3d>(&m.x);}
+inline Eigen::Map<const Eigen::Vector3d> vectorView(const geometry_msgs::Point& m) {return Eigen::Map<const Eigen::Vector3d>(&m.x);}
+
+//Eigen stores quaternion coefficients as x y z w, the message order
+inline Eigen::Map<Eigen::Quaterniond> quaternionView(geometry_msgs::Quaternion& m) {return Eigen::Map<Eigen::Quaterniond>(&m.x);}
+inline Eigen::Map<const Eigen::Quaterniond> quaternionView(const geometry_msgs::Quaternion& m) {return Eigen::Map<const Eigen::Quaterniond>(&m.x);}
+
+#endif //_msgViews_h_
@@ -1,3 +1,7 @@
+
+#ifndef _planner_h_
+#define _planner_h_
+
 #include "ros/ros.h"
 #include "boost/thread.hpp"
 #include <eigen3/Eigen/Dense>
@@ -15,9 +19,9 @@ bool T_RPY(Eigen::Matrix3d &R, double phi, double theta, double psi);
 bool Tdot_RPY(Eigen::Matrix3d &R, double phi, double theta, double psi);
 Matrix3d Skew(Vector3d v);
 Vector3d Vee(Matrix3d S);
-void twist2Vector(const geometry_msgs::TwistStamped twist, VectorXd& vel);
-void accel2Vector(const geometry_msgs::AccelStamped acc, VectorXd& a);
-void wrench2Vector(const geometry_msgs::WrenchStamped wrench, VectorXd& w);
+void twist2Vector(const geometry_msgs::TwistStamped& twist, VectorXd& vel);
+void accel2Vector(const geometry_msgs::AccelStamped& acc, VectorXd& a);
+void wrench2Vector(const geometry_msgs::WrenchStamped& wrench, VectorXd& w);
 
 class SPLINE_PLANNER {
 	public:
@@ -58,7 +62,6 @@ class CARTESIAN_PLANNER {
 		std::vector<double> _t;
 
 	private:
-		void R_axisAngle(double th, Vector3d r, Matrix3d &R);
     std::vector<geometry_msgs::PoseStamped> _poses;
     std::vector<double> _times;
 		SPLINE_PLANNER xplanner,yplanner,zplanner,aplanner;
@@ -67,3 +70,5 @@ class CARTESIAN_PLANNER {
 		int _counter;
 		Eigen::VectorXd _xdi,_xdf,_xddi,_xddf;
 };
+
+#endif //_planner_h_
@@ -0,0 +1,50 @@
+
+#ifndef _pose_h_
+#define _pose_h_
+
+#include <cmath>
+#include <eigen3/Eigen/Dense>
+#include <kdl/frames.hpp>
+#include "geometry_msgs/Pose.h"
+#include "msgViews.h"
+
+//Controller pose: unit quaternion and position. Messages are converted only at the ROS boundary
+struct POSE {
+	Eigen::Quaterniond q;
+	Eigen::Vector3d p;
+	POSE() : q(Eigen::Quaterniond::Identity()), p(Eigen::Vector3d::Zero()) {};
+	POSE(const Eigen::Quaterniond& q_, const Eigen::Vector3d& p_) : q(q_), p(p_) {};
+	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+inline void msg2Pose(const geometry_msgs::Pose& m, POSE& x) {
+	x.p = vectorView(m.position);
+	x.q = quaternionView(m.orientation);
+}
+
+inline void pose2Msg(const POSE& x, geometry_msgs::Pose& m) {
+	vectorView(m.position) = x.p;
+	quaternionView(m.orientation) = x.q;
+}
+
+inline void pose2Frame(const POSE& x, KDL::Frame& F) {
+	Eigen::Map<Eigen::Matrix<double,3,3,Eigen::RowMajor> >(F.M.data) = x.q.toRotationMatrix();
+	F.p = KDL::Vector(x.p(0), x.p(1), x.p(2));
+}
+
+//Orientation displaced by the rotational admittance state z, the vector part of the quaternion error
+//expressed in the base frame
+inline Eigen::Quaterniond compliantOrientation(const Eigen::Quaterniond& qd, const Eigen::Vector3d& z) {
+	Eigen::Vector3d eps = qd.conjugate()*z;
+	double eta = sqrt(std::max(0.0, 1.0 - eps.squaredNorm()));
+	return qd*Eigen::Quaterniond(eta, eps(0), eps(1), eps(2));
+}
+
+//Vector part of the quaternion error from qe to qd along the shortest rotation, in the base frame
+inline Eigen::Vector3d orientationError(const Eigen::Quaterniond& qe, const Eigen::Quaterniond& qd) {
+	Eigen::Quaterniond qerr = qe.conjugate()*qd;
+	Eigen::Vector3d eps = (qerr.w() < 0) ? Eigen::Vector3d(-qerr.vec()) : Eigen::Vector3d(qerr.vec());
+	return qe*eps;
+}
+
+#endif //_pose_h_
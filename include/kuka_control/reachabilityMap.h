@@ -0,0 +1,59 @@
+
+#ifndef _reachabilityMap_h_
+#define _reachabilityMap_h_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <cstring>
+#include <kdl/frames.hpp>
+
+//Voxel grid over the workspace, each voxel split in azimuth x elevation bins of the tool z axis and
+//roll bins about it. Every cell keeps the best (highest manipulability) joint configuration reaching it,
+//to seed IK. The map is only valid for the model, tip link and chain geometry it was built from.
+//File layout: REACH_MAP_HEADER followed by the cells, (1+nj) floats each: manipulability, q[0..nj-1]
+struct REACH_MAP_HEADER {
+	char magic[8];
+	uint32_t version;
+	uint32_t nj;
+	char model[32];
+	char tip[64];
+	uint64_t chainHash; //ROBOT_MODEL::chainHash
+	double origin[3];
+	double resolution;
+	uint32_t dims[3];
+	uint32_t azBins, elBins, rollBins;
+};
+
+class REACHABILITY_MAP {
+	public:
+		REACHABILITY_MAP();
+		~REACHABILITY_MAP();
+		//Empty in-memory map, to be filled with insert() and written with save()
+		void create(const double origin[3], double resolution, const uint32_t dims[3], uint32_t azBins, uint32_t elBins, uint32_t rollBins,
+		            uint32_t nj, const std::string& model, const std::string& tip, uint64_t chainHash);
+		bool insert(const KDL::Frame& F, const double* q, float manipulability);
+		bool save(const std::string& file) const;
+		//Memory-maps a saved map (read-only)
+		bool load(const std::string& file);
+		//O(1) lookup: seed configuration for F, NULL if the cell is outside the grid or empty
+		const float* seed(const KDL::Frame& F, float* manipulability=NULL) const;
+		bool isLoaded() const {return _cells!=NULL;};
+		//Built for this model, tip link and chain
+		bool matches(const std::string& model, const std::string& tip, uint64_t chainHash) const;
+		uint32_t getNrOfJoints() const {return _header.nj;};
+		std::string model() const {return std::string(_header.model, strnlen(_header.model, sizeof(_header.model)));};
+		std::string tip() const {return std::string(_header.tip, strnlen(_header.tip, sizeof(_header.tip)));};
+		void unload();
+	private:
+		long cellIndex(const KDL::Frame& F) const;
+		REACH_MAP_HEADER _header;
+		uint32_t _stride;
+		long _nCells;
+		std::vector<float> _storage;
+		void* _mapped;
+		size_t _mappedSize;
+		float* _cells;
+};
+
+#endif //_reachabilityMap_h_
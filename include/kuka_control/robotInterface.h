@@ -0,0 +1,70 @@
+
+#ifndef _robotInterface_h_
+#define _robotInterface_h_
+
+#include "ros/ros.h"
+#include "boost/thread.hpp"
+#include "sensor_msgs/JointState.h"
+#include <std_msgs/Float64MultiArray.h>
+
+#include "mailbox.h"
+#include "jointStateMap.h"
+#include "streamSpinner.h"
+#include "asyncLog.h"
+#include "friShm.h"
+
+//Joint command of one control tick, chain order
+struct ROBOT_COMMAND {
+	double q[7], tau[7];
+	bool torque; //in torque mode q holds the measured configuration
+};
+
+//Where the control thread reads the arm state and sends its command. States without joint names
+//are in chain order. init reads the backend parameters from the private namespace
+class ROBOT_INTERFACE {
+	public:
+		virtual ~ROBOT_INTERFACE() {};
+		virtual bool init(ros::NodeHandle& nh, ros::NodeHandle& pnh) = 0;
+		//Blocks until a state newer than the previous one; empty when stop is set first
+		virtual sensor_msgs::JointStateConstPtr waitState(const volatile bool& stop) = 0;
+		virtual bool sendCommand(const ROBOT_COMMAND& cmd) = 0;
+		//Logs the counters since the previous call
+		virtual void report() = 0;
+};
+
+//ROS topics: /iiwa/joint_states on its own queue and thread, the latest arm state taken by the control thread.
+//Commands on /iiwa/jointsCommand and /iiwa/jointsTorqueCommand for rosToFri
+class ROS_ROBOT : public ROBOT_INTERFACE {
+	public:
+		ROS_ROBOT(uint32_t queueSize, bool threaded, const std::vector<std::string>& jointNames) : _queueSize(queueSize), _threaded(threaded), _torque(false) {_jsMap.setJointNames(jointNames);};
+		bool init(ros::NodeHandle& nh, ros::NodeHandle& pnh);
+		sensor_msgs::JointStateConstPtr waitState(const volatile bool& stop);
+		bool sendCommand(const ROBOT_COMMAND& cmd);
+		void report();
+	private:
+		void joint_states_cb(const sensor_msgs::JointStateConstPtr& js);
+		uint32_t _queueSize;
+		bool _threaded, _torque;
+		JOINT_STATE_MAP _jsMap; //callback thread only
+		MAILBOX<sensor_msgs::JointState> _mailbox;
+		ros::Subscriber _js_sub;
+		ros::Publisher _js_pub, _torque_pub;
+		STREAM_SPINNER _spinner; //last: its thread stops first
+};
+
+//Shared memory segment of the FRI bridge (~shm_name), waited for ~shm_wait seconds
+class SHM_ROBOT : public ROBOT_INTERFACE {
+	public:
+		bool init(ros::NodeHandle& nh, ros::NodeHandle& pnh);
+		sensor_msgs::JointStateConstPtr waitState(const volatile bool& stop);
+		bool sendCommand(const ROBOT_COMMAND& cmd);
+		void report();
+	private:
+		FRI_SHM _fri;
+		SHM_JOINT_COMMAND _cmd;
+		STREAM_STATS _stats;
+		uint64_t _cmdSkipped; //commands overwritten unread at the last report
+		boost::mutex _mutex;
+};
+
+#endif //_robotInterface_h_
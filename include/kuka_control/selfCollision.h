@@ -0,0 +1,33 @@
+
+#ifndef _selfCollision_h_
+#define _selfCollision_h_
+
+#include <vector>
+#include "linkCapsules.h"
+
+//Self-collision monitor over the capsules of LINK_CAPSULES.
+//Pair distances are computed 4 at a time on SoA buffers (segment-segment closest points, branch-free)
+class SELF_COLLISION {
+	public:
+		SELF_COLLISION() {_nPairs=0; _margin=0;};
+		//Pairs of capsules at least minGap apart along the chain. Pairs already overlapping at q_ref
+		//(e.g. the wrist links around a short link) are left out, as they touch by construction
+		void init(LINK_CAPSULES& capsules, const KDL::JntArray& q_ref, int minGap=2, double margin=0.01);
+		//Smallest clearance (surface distance minus margin) over the pairs of the last capsules.update();
+		//negative means collision. worst gets the pair index
+		double check(const LINK_CAPSULES& capsules, int* worst=NULL);
+		int size() const {return _nPairs;};
+		int first(int pair) const {return _first[pair];};
+		int second(int pair) const {return _second[pair];};
+	private:
+		void resize(int nPairs);
+		void kernel(int first);
+		int _nPairs;
+		double _margin;
+		std::vector<int> _first, _second;
+		//SoA pair buffers, padded to a multiple of 4 lanes
+		std::vector<double> _p[12]; //a1, b1, a2, b2 coordinates
+		std::vector<double> _rsum, _clearance;
+};
+
+#endif //_selfCollision_h_
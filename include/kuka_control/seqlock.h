@@ -0,0 +1,39 @@
+
+#ifndef _seqlock_h_
+#define _seqlock_h_
+
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+
+//Snapshot shared by one writer and any number of readers without locks:
+//the writer never waits, a reader copies again when a write overlapped its copy
+template<class T>
+class SEQLOCK {
+	public:
+		static_assert(std::is_trivially_copyable<T>::value, "snapshots are copied as plain memory");
+		SEQLOCK() : _seq(0) {};
+		void write(const T& v) {
+			unsigned long s = _seq.load(std::memory_order_relaxed);
+			_seq.store(s+1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			memcpy(&_data, &v, sizeof(T));
+			_seq.store(s+2, std::memory_order_release);
+		};
+		//False while nothing has been written yet
+		bool read(T& v) const {
+			unsigned long s0, s1;
+			do {
+				s0 = _seq.load(std::memory_order_acquire);
+				memcpy(&v, &_data, sizeof(T));
+				std::atomic_thread_fence(std::memory_order_acquire);
+				s1 = _seq.load(std::memory_order_relaxed);
+			} while((s0 & 1) || s0 != s1);
+			return s0 != 0;
+		};
+	private:
+		std::atomic<unsigned long> _seq;
+		T _data;
+};
+
+#endif //_seqlock_h_
@@ -0,0 +1,108 @@
+
+#ifndef _streamSpinner_h_
+#define _streamSpinner_h_
+
+#include <string>
+#include <pthread.h>
+#include <sched.h>
+#include "ros/ros.h"
+#include "ros/callback_queue.h"
+#include "boost/thread.hpp"
+#include "boost/function.hpp"
+#include "std_msgs/Float64MultiArray.h"
+#include "tickBudget.h"
+
+//One sensor stream on its own callback queue and thread, so a burst on one topic does not hold back the others.
+//~streams/<name>/cpu pins the thread (-1: any), ~streams/<name>/priority > 0 runs it SCHED_FIFO.
+//Wait (receipt to dispatch) and service times of the callbacks are published on /iiwa/callback_latency/<name>
+//as [callbacks, wait p50, wait p99, wait max, service p99, service max], seconds
+class STREAM_SPINNER {
+	public:
+		STREAM_SPINNER() : _threaded(false), _stop(false), _cpu(-1), _priority(0) {
+			_wait.init(1e-5, 0.1);
+			_service.init(1e-6, 0.01);
+		};
+		~STREAM_SPINNER() {
+			_stop = true;
+			_thread.join();
+		};
+		//threaded false: the callbacks stay on the node handle queue, the statistics are still collected
+		void init(const std::string& name, ros::NodeHandle& nh, ros::NodeHandle& pnh, bool threaded) {
+			_name = name;
+			_threaded = threaded;
+			pnh.param("streams/" + name + "/cpu", _cpu, -1);
+			pnh.param("streams/" + name + "/priority", _priority, 0);
+			_stats_pub = nh.advertise<std_msgs::Float64MultiArray>("/iiwa/callback_latency/" + name, 1);
+		};
+		template<class M>
+		ros::Subscriber subscribe(ros::NodeHandle& nh, const std::string& topic, uint32_t queueSize,
+				const boost::function<void(const boost::shared_ptr<M const>&)>& cb, const ros::TransportHints& hints = ros::TransportHints()) {
+			ros::SubscribeOptions ops;
+			ops.template initByFullCallbackType<const ros::MessageEvent<M const>&>(topic, queueSize,
+				boost::function<void(const ros::MessageEvent<M const>&)>(boost::bind(&STREAM_SPINNER::dispatch<M>, this, _1, cb)));
+			ops.transport_hints = hints;
+			if(_threaded) ops.callback_queue = &_queue;
+			return nh.subscribe(ops);
+		};
+		void start() {
+			if(_threaded) _thread = boost::thread(&STREAM_SPINNER::spin, this);
+		};
+		//Statistics since the previous call
+		void publishStats() {
+			std_msgs::Float64MultiArray msg;
+			msg.data.resize(6);
+			_statsMutex.lock();
+			msg.data[0] = _wait.count();
+			msg.data[1] = _wait.percentile(50);
+			msg.data[2] = _wait.percentile(99);
+			msg.data[3] = _wait.max();
+			msg.data[4] = _service.percentile(99);
+			msg.data[5] = _service.max();
+			_wait.reset();
+			_service.reset();
+			_statsMutex.unlock();
+			if(msg.data[0] > 0)
+				ROS_DEBUG("%s callbacks: %.0f, wait p99 %f s, service p99 %f s", _name.c_str(), msg.data[0], msg.data[2], msg.data[4]);
+			_stats_pub.publish(msg);
+		};
+	private:
+		template<class M>
+		void dispatch(const ros::MessageEvent<M const>& event, const boost::function<void(const boost::shared_ptr<M const>&)>& cb) {
+			double wait = (ros::Time::now() - event.getReceiptTime()).toSec();
+			ros::WallTime start = ros::WallTime::now();
+			cb(event.getMessage());
+			double service = (ros::WallTime::now() - start).toSec();
+			_statsMutex.lock();
+			_wait.add(wait);
+			_service.add(service);
+			_statsMutex.unlock();
+		};
+		void spin() {
+			if(_cpu >= 0) {
+				cpu_set_t set;
+				CPU_ZERO(&set);
+				CPU_SET(_cpu, &set);
+				if(pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+					ROS_WARN("%s thread: cannot pin to cpu %d", _name.c_str(), _cpu);
+			}
+			if(_priority > 0) {
+				sched_param sp;
+				sp.sched_priority = _priority;
+				if(pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp) != 0)
+					ROS_WARN("%s thread: SCHED_FIFO priority %d not permitted, running at normal priority", _name.c_str(), _priority);
+			}
+			while(!_stop && ros::ok())
+				_queue.callAvailable(ros::WallDuration(0.01));
+		};
+		std::string _name;
+		bool _threaded;
+		volatile bool _stop;
+		int _cpu, _priority;
+		ros::CallbackQueue _queue;
+		boost::thread _thread;
+		boost::mutex _statsMutex;
+		TICK_BUDGET _wait, _service;
+		ros::Publisher _stats_pub;
+};
+
+#endif //_streamSpinner_h_
@@ -0,0 +1,48 @@
+
+#ifndef _tickBudget_h_
+#define _tickBudget_h_
+
+#include <vector>
+#include <algorithm>
+
+//Histogram of control tick durations: percentiles over a window without storing the samples.
+//Durations above range fall in the last bin and are reported as the window maximum
+class TICK_BUDGET {
+	public:
+		TICK_BUDGET() {init(1e-6, 0.01);};
+		void init(double resolution, double range) {
+			_res = resolution;
+			_bins.assign((size_t)(range/resolution) + 1, 0);
+			reset();
+		};
+		void reset() {
+			std::fill(_bins.begin(), _bins.end(), 0);
+			_n = 0;
+			_max = 0;
+		};
+		void add(double t) {
+			size_t b = (t > 0) ? std::min((size_t)(t/_res), _bins.size()-1) : 0;
+			_bins[b]++;
+			_n++;
+			_max = std::max(_max, t);
+		};
+		//Upper edge of the bin holding the p-th percentile (0 < p <= 100)
+		double percentile(double p) const {
+			if(_n == 0) return 0;
+			unsigned long target = (unsigned long)(p/100.0*_n + 0.5);
+			unsigned long acc = 0;
+			for(size_t b=0; b<_bins.size()-1; b++) {
+				acc += _bins[b];
+				if(acc >= target) return std::min((b+1)*_res, _max);
+			}
+			return _max;
+		};
+		unsigned long count() const {return _n;};
+		double max() const {return _max;};
+	private:
+		std::vector<unsigned long> _bins;
+		double _res, _max;
+		unsigned long _n;
+};
+
+#endif //_tickBudget_h_
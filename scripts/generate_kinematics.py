@@ -0,0 +1,272 @@
+#!/usr/bin/env python
+"""Generates unrolled forward kinematics, Jacobian and Jacobian derivative for a serial URDF chain.
+
+Usage: generate_kinematics.py <urdf> <model> <base_link> <tip_link> <output_header>
+
+The chain is rewritten as D0*Rz(q1)*D1*...*Rz(qn)*Dn (every joint axis moved onto z by a constant
+frame), like BATCH_KINEMATICS does at run time. The constant frames are emitted as literals, entries
+that are 0 or +-1 are folded away, and the result is a GENERATED_KINEMATICS<MODEL> specialization
+with straight-line code for the model.
+"""
+
+import math
+import sys
+import xml.etree.ElementTree as ET
+
+EPS = 1e-12
+
+
+def rpy_matrix(r, p, y):
+    cr, sr = math.cos(r), math.sin(r)
+    cp, sp = math.cos(p), math.sin(p)
+    cy, sy = math.cos(y), math.sin(y)
+    return [[cy * cp, cy * sp * sr - sy * cr, cy * sp * cr + sy * sr],
+            [sy * cp, sy * sp * sr + cy * cr, sy * sp * cr - cy * sr],
+            [-sp, cp * sr, cp * cr]]
+
+
+def mat_mul(A, B):
+    return [[sum(A[i][k] * B[k][j] for k in range(3)) for j in range(3)] for i in range(3)]
+
+
+def mat_vec(A, v):
+    return [sum(A[i][k] * v[k] for k in range(3)) for i in range(3)]
+
+
+def transpose(A):
+    return [[A[j][i] for j in range(3)] for i in range(3)]
+
+
+def frame_mul(F, G):
+    R = mat_mul(F[0], G[0])
+    p = [a + b for a, b in zip(mat_vec(F[0], G[1]), F[1])]
+    return (R, p)
+
+
+def frame_inv(F):
+    Rt = transpose(F[0])
+    return (Rt, [-x for x in mat_vec(Rt, F[1])])
+
+
+IDENTITY = ([[1.0, 0.0, 0.0], [0.0, 1.0, 0.0], [0.0, 0.0, 1.0]], [0.0, 0.0, 0.0])
+
+
+def axis_frame(axis):
+    """Rotation with z along axis."""
+    n = math.sqrt(sum(a * a for a in axis))
+    z = [a / n for a in axis]
+    x = [1.0, 0.0, 0.0] if abs(z[0]) < 0.9 else [0.0, 1.0, 0.0]
+    d = sum(a * b for a, b in zip(x, z))
+    x = [a - d * b for a, b in zip(x, z)]
+    n = math.sqrt(sum(a * a for a in x))
+    x = [a / n for a in x]
+    y = [z[1] * x[2] - z[2] * x[1], z[2] * x[0] - z[0] * x[2], z[0] * x[1] - z[1] * x[0]]
+    return ([[x[i], y[i], z[i]] for i in range(3)], [0.0, 0.0, 0.0])
+
+
+def parse_chain(urdf_file, base, tip):
+    root = ET.parse(urdf_file).getroot()
+    by_child = {}
+    for j in root.findall('joint'):
+        by_child[j.find('child').get('link')] = j
+
+    joints = []
+    link = tip
+    while link != base:
+        if link not in by_child:
+            raise RuntimeError('%s is not below %s' % (tip, base))
+        j = by_child[link]
+        joints.append(j)
+        link = j.find('parent').get('link')
+    joints.reverse()
+
+    chain = []
+    for j in joints:
+        origin = j.find('origin')
+        xyz = [float(v) for v in origin.get('xyz', '0 0 0').split()] if origin is not None else [0.0] * 3
+        rpy = [float(v) for v in origin.get('rpy', '0 0 0').split()] if origin is not None else [0.0] * 3
+        axis_el = j.find('axis')
+        axis = [float(v) for v in axis_el.get('xyz').split()] if axis_el is not None else [1.0, 0.0, 0.0]
+        jtype = j.get('type')
+        if jtype not in ('fixed', 'revolute', 'continuous'):
+            raise RuntimeError('joint %s: %s joints are not supported' % (j.get('name'), jtype))
+        chain.append((j.get('name'), jtype, (rpy_matrix(*rpy), xyz), axis))
+    return chain
+
+
+def constant_frames(chain):
+    """D0..Dn such that the tip pose is D0*Rz(q1)*D1*...*Rz(qn)*Dn."""
+    D = []
+    names = []
+    T = IDENTITY
+    for name, jtype, origin, axis in chain:
+        if jtype == 'fixed':
+            T = frame_mul(T, origin)
+            continue
+        A = axis_frame(axis)
+        D.append(frame_mul(frame_mul(T, origin), A))
+        T = frame_inv(A)
+        names.append(name)
+    D.append(T)
+    return D, names
+
+
+def lit(x):
+    return repr(float(x))
+
+
+def lin(terms):
+    """C++ expression for sum(coeff*var), folding 0 and +-1 coefficients."""
+    out = ''
+    for c, v in terms:
+        if abs(c) < EPS:
+            continue
+        if v is None:
+            s = lit(abs(c))
+        elif abs(abs(c) - 1.0) < EPS:
+            s = v
+        else:
+            s = lit(abs(c)) + '*' + v
+        if not out:
+            out = ('-' if c < 0 else '') + s
+        else:
+            out += (' - ' if c < 0 else ' + ') + s
+    return out if out else '0.0'
+
+
+class Emitter(object):
+    def __init__(self):
+        self.lines = []
+
+    def let(self, name, expr):
+        self.lines.append('\t\tconst double %s = %s;' % (name, expr))
+
+    def raw(self, line):
+        self.lines.append(line)
+
+
+def emit_chain(e, D, nj, record):
+    """Pose R{k}_{ij}, p{k}_{i} after every joint; with record, joint axes z{j}_i and origins o{j}_i."""
+    R0, p0 = D[0]
+    for i in range(3):
+        for j in range(3):
+            e.let('R0_%d%d' % (i, j), lit(R0[i][j]) if abs(R0[i][j]) > EPS else '0.0')
+    for i in range(3):
+        e.let('p0_%d' % i, lit(p0[i]) if abs(p0[i]) > EPS else '0.0')
+
+    for k in range(nj):
+        a, b = k, k + 1
+        e.let('c%d' % k, 'cos(q[%d])' % k)
+        e.let('s%d' % k, 'sin(q[%d])' % k)
+        if record:
+            for i in range(3):
+                e.let('z%d_%d' % (k, i), 'R%d_%d2' % (a, i))
+                e.let('o%d_%d' % (k, i), 'p%d_%d' % (a, i))
+        # M = R*Rz(q): first two columns rotate
+        for i in range(3):
+            e.let('M%d_%d0' % (k, i), 'c%d*R%d_%d0 + s%d*R%d_%d1' % (k, a, i, k, a, i))
+            e.let('M%d_%d1' % (k, i), 'c%d*R%d_%d1 - s%d*R%d_%d0' % (k, a, i, k, a, i))
+            e.let('M%d_%d2' % (k, i), 'R%d_%d2' % (a, i))
+        # (R,p) = (M,p)*D[k+1]
+        DR, Dp = D[k + 1]
+        for i in range(3):
+            m = ['M%d_%d%d' % (k, i, c) for c in range(3)]
+            for j in range(3):
+                e.let('R%d_%d%d' % (b, i, j), lin([(DR[c][j], m[c]) for c in range(3)]))
+            e.let('p%d_%d' % (b, i), lin([(1.0, 'p%d_%d' % (a, i))] + [(Dp[c], m[c]) for c in range(3)]))
+
+
+def cross(a, b):
+    return ['%s*%s - %s*%s' % (a[1], b[2], a[2], b[1]),
+            '%s*%s - %s*%s' % (a[2], b[0], a[0], b[2]),
+            '%s*%s - %s*%s' % (a[0], b[1], a[1], b[0])]
+
+
+def generate(urdf_file, model, base, tip, out_file):
+    chain = parse_chain(urdf_file, base, tip)
+    D, names = constant_frames(chain)
+    nj = len(names)
+    tag = model.upper()
+    guard = '_%sKinematics_h_' % model
+
+    # fk
+    fk = Emitter()
+    emit_chain(fk, D, nj, False)
+    for i in range(3):
+        for j in range(3):
+            fk.raw('\t\tR(%d,%d) = R%d_%d%d;' % (i, j, nj, i, j))
+        fk.raw('\t\tp(%d) = p%d_%d;' % (i, nj, i))
+
+    # pose, Jacobian and its derivative
+    full = Emitter()
+    emit_chain(full, D, nj, True)
+    pe = ['p%d_%d' % (nj, i) for i in range(3)]
+    for i in range(3):
+        for j in range(3):
+            full.raw('\t\tR(%d,%d) = R%d_%d%d;' % (i, j, nj, i, j))
+        full.raw('\t\tp(%d) = %s;' % (i, pe[i]))
+
+    for k in range(nj):
+        z = ['z%d_%d' % (k, i) for i in range(3)]
+        for i in range(3):
+            full.let('r%d_%d' % (k, i), '%s - o%d_%d' % (pe[i], k, i))
+        r = ['r%d_%d' % (k, i) for i in range(3)]
+        v = cross(z, r)
+        for i in range(3):
+            full.raw('\t\tJ(%d,%d) = %s;' % (i, k, v[i]))
+            full.raw('\t\tJ(%d,%d) = %s;' % (3 + i, k, z[i]))
+
+    # w{k}: angular velocity of the link before joint k; od{k}: velocity of joint origin k
+    for i in range(3):
+        full.let('w0_%d' % i, '0.0')
+        full.let('od0_%d' % i, '0.0')
+    for k in range(nj):
+        z = ['z%d_%d' % (k, i) for i in range(3)]
+        w = ['w%d_%d' % (k, i) for i in range(3)]
+        for i in range(3):
+            full.let('w%d_%d' % (k + 1, i), '%s + %s*qd[%d]' % (w[i], z[i], k))
+        wn = ['w%d_%d' % (k + 1, i) for i in range(3)]
+        # next origin (or the tip) moves with the link after joint k
+        nxt = ['o%d_%d' % (k + 1, i) for i in range(3)] if k + 1 < nj else pe
+        for i in range(3):
+            full.let('d%d_%d' % (k, i), '%s - o%d_%d' % (nxt[i], k, i))
+        dv = cross(wn, ['d%d_%d' % (k, i) for i in range(3)])
+        for i in range(3):
+            full.let('od%d_%d' % (k + 1, i), 'od%d_%d + %s' % (k, i, dv[i]))
+    ped = ['od%d_%d' % (nj, i) for i in range(3)]  # tip velocity
+    for k in range(nj):
+        z = ['z%d_%d' % (k, i) for i in range(3)]
+        zd = cross(['w%d_%d' % (k, i) for i in range(3)], z)
+        for i in range(3):
+            full.let('zd%d_%d' % (k, i), zd[i])
+        zdv = ['zd%d_%d' % (k, i) for i in range(3)]
+        for i in range(3):
+            full.let('rd%d_%d' % (k, i), '%s - od%d_%d' % (ped[i], k, i))
+        a = cross(zdv, ['r%d_%d' % (k, i) for i in range(3)])
+        b = cross(z, ['rd%d_%d' % (k, i) for i in range(3)])
+        for i in range(3):
+            full.raw('\t\tJdot(%d,%d) = %s + %s;' % (i, k, a[i], b[i]))
+            full.raw('\t\tJdot(%d,%d) = %s;' % (3 + i, k, zdv[i]))
+
+    with open(out_file, 'w') as f:
+        f.write('//Generated by scripts/generate_kinematics.py from %s (%s -> %s). Do not edit.\n' % (model, base, tip))
+        f.write('#ifndef %s\n#define %s\n\n' % (guard, guard))
+        f.write('template<>\nstruct GENERATED_KINEMATICS<%s> {\n' % tag)
+        f.write('\tstatic constexpr int NJ = %d;\n' % nj)
+        f.write('\ttypedef Eigen::Matrix<double,6,NJ> Jacobian;\n')
+        f.write('\tstatic constexpr const char* BASE = "%s";\n' % base)
+        f.write('\tstatic constexpr const char* TIP = "%s";\n\n' % tip)
+        f.write('\t//Tip pose in the base frame\n')
+        f.write('\tstatic inline void fk(const double* q, Eigen::Matrix3d& R, Eigen::Vector3d& p) {\n')
+        f.write('\n'.join(fk.lines) + '\n\t}\n\n')
+        f.write('\t//Tip pose, Jacobian and its time derivative (reference point on the tip, base frame, as KDL)\n')
+        f.write('\tstatic inline void compute(const double* q, const double* qd, Eigen::Matrix3d& R, Eigen::Vector3d& p, Jacobian& J, Jacobian& Jdot) {\n')
+        f.write('\n'.join(full.lines) + '\n\t}\n')
+        f.write('};\n\n#endif //%s\n' % guard)
+
+
+if __name__ == '__main__':
+    if len(sys.argv) != 6:
+        sys.stderr.write(__doc__)
+        sys.exit(1)
+    generate(*sys.argv[1:])
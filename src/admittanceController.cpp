@@ -1,294 +1,88 @@
-#include "ros/ros.h"
-#include "boost/thread.hpp"
-#include "sensor_msgs/JointState.h"
-#include "geometry_msgs/PoseStamped.h"
-#include "geometry_msgs/TwistStamped.h"
-#include "geometry_msgs/AccelStamped.h"
-#include "gazebo_msgs/ContactsState.h"
-#include <std_msgs/Float64.h>
-#include <std_msgs/Float64MultiArray.h>
-#include <geometry_msgs/WrenchStamped.h>
-#include <geometry_msgs/PointStamped.h>
-
-#include <kdl_parser/kdl_parser.hpp>
-#include <kdl/chainfksolvervel_recursive.hpp>
-#include <kdl/chainfksolverpos_recursive.hpp>
-#include <kdl/chainiksolvervel_pinv.hpp>
-#include <kdl/chainfksolverpos_recursive.hpp>
-#include <kdl/chainiksolverpos_nr.hpp>
-#include <kdl/chainjnttojacsolver.hpp>
-#include <kdl/chainjnttojacdotsolver.hpp>
-#include <kdl/chaindynparam.hpp>
-
-#include "../include/kuka_control/planner.h"
-#include <kuka_control/waypointsAction.h>
-#include <actionlib/server/simple_action_server.h>
-
-#include "../include/kuka_control/LowPassFilter.hpp"
+#include "../include/kuka_control/admittanceController.h"
+#include <fstream>
+#include <algorithm>
 
 using namespace std;
 
+//Yaw increment about the base z axis: the RPY yaw plus incyaw, without going through the angles
 void rotateYaw(const geometry_msgs::PoseStamped& init, geometry_msgs::PoseStamped& final, double incyaw) {
-  tf::Matrix3x3 initR;
-  tf::Quaternion initq(init.pose.orientation.x,init.pose.orientation.y,init.pose.orientation.z,init.pose.orientation.w);
-  initR.setRotation(initq);
-
-  double roll,pitch,yaw;
-  initR.getRPY(roll,pitch,yaw);
-  yaw+=incyaw;
-  initR.setRPY(roll,pitch,yaw);
-  initR.getRotation(initq);
-
-  final.pose.orientation.x = initq.x();
-  final.pose.orientation.y = initq.y();
-  final.pose.orientation.z = initq.z();
-  final.pose.orientation.w = initq.w();
-}
-
-class ETank {
-	public:
-		ETank(double Einit, double Emin, double Emax, double dt) {_Et=Einit;_Emin=Emin; _Emax=Emax; _xt=sqrt(2*_Et);_dt=dt;};
-		void update(const Eigen::VectorXd input, const Eigen::MatrixXd Kd, const Eigen::VectorXd x_dot, const Eigen::VectorXd Kpxtilde);
-		double getEt() {return _Et;};
-		double _alpha;
-	private:
-		double _Et, _Emin, _Emax, _xt;
-		double _beta;
-		double _dt;
-};
-
-void ETank::update(const Eigen::VectorXd input, const Eigen::MatrixXd Kd, const Eigen::VectorXd x_dot, const Eigen::VectorXd Kpxtilde) {
-	if(_Et<=_Emax) _beta=1;
-	else _beta=0;
-
-	double w = input.dot(Kpxtilde);
-
-	double f_energy = 0.5*( 1 - cos(M_PI*(_Et-_Emin)/(_Emax-_Emin)) );
-	double g_input;
-	if(w<=0) g_input=0;
-	else	g_input=1;
-
-	_alpha = f_energy*g_input + (1-g_input);
-
-	double gamma;
-	if( (_Et>=_Emin) && w>=0 ) gamma=_alpha;
-	else gamma=0;
-
-	w=gamma*w;
-
-	double eta=0.5;
-	double Diss = x_dot.transpose()*Kd*x_dot;
-
-	double ut = -(1.0/_xt)*w;
-	cout<<"Ut: "<<ut<<endl;
-	double xt_dot = (_beta*eta/_xt)*Diss + ut;
-	_xt += xt_dot*_dt;
-	_Et = 0.5*_xt*_xt;
+  Eigen::Quaterniond q(init.pose.orientation.w,init.pose.orientation.x,init.pose.orientation.y,init.pose.orientation.z);
+  q = Eigen::AngleAxisd(incyaw, Eigen::Vector3d::UnitZ())*q;
 
+  final.pose.orientation.x = q.x();
+  final.pose.orientation.y = q.y();
+  final.pose.orientation.z = q.z();
+  final.pose.orientation.w = q.w();
 }
 
-class ETankGen {
-	public:
-		ETankGen(double Einit, double Emin, double Emax, double dt, int inputSize);
-		void update(const std::vector<double> inputs, const std::vector<double> dissInputs);
-		double getEt() {return _Et;};
-		std::vector<double> _alpha;
-	private:
-		double _Et, _Emin, _Emax, _xt;
-		double _beta;
-		double _dt;
-};
-
-ETankGen::ETankGen(double Einit, double Emin, double Emax, double dt, int inputSize) {
-	_Et=Einit;
-	_Emin=Emin;
-	_Emax=Emax;
-	_xt=sqrt(2*_Et);
-	_dt=dt;
-	for (int i=0; i<inputSize; i++) {
-		_alpha.push_back(1);
-	}
+void pose2Array(const POSE& x, double a[7]) {
+	a[0] = x.p(0);
+	a[1] = x.p(1);
+	a[2] = x.p(2);
+	a[3] = x.q.x();
+	a[4] = x.q.y();
+	a[5] = x.q.z();
+	a[6] = x.q.w();
 }
 
-void ETankGen::update(const std::vector<double> inputs, const std::vector<double> dissInputs) {
-	if(_Et<=_Emax) _beta=1;
-	else _beta=0;
-
-	double f_energy = 0.5*( 1 - cos(M_PI*(_Et-_Emin)/(_Emax-_Emin)) );
-	double eta=0.8;
-	double Diss=0;
-	double wtot = 0;
-
-	for (int i=0; i<dissInputs.size(); i++)
-		Diss+=dissInputs[i];
-
-	for (int i=0; i<_alpha.size(); i++) {
-		double w = inputs[i];
-		double g_input;
-		if(w<=0) g_input=0;
-		else	g_input=1;
-
-		_alpha[i] = f_energy*g_input + (1-g_input);
-		double gamma;
-		if( (_Et>=_Emin) && w>=0 ) gamma=_alpha[i];
-		else gamma=0;
-
-		//if(i==1) cout<<"Power: "<<gamma*w<<endl;
-
-		wtot+=gamma*w;
-		//if(w!=0) cout<<"Power: "<<w<<"  Diss: "<<Diss<<endl;
-	}
+void array2Pose(const double a[7], geometry_msgs::PoseStamped& p) {
+	p.pose.position.x = a[0];
+	p.pose.position.y = a[1];
+	p.pose.position.z = a[2];
+	p.pose.orientation.x = a[3];
+	p.pose.orientation.y = a[4];
+	p.pose.orientation.z = a[5];
+	p.pose.orientation.w = a[6];
+}
 
-	double ut = -(1.0/_xt)*wtot;
-	double xt_dot = (_beta*eta/_xt)*Diss + ut;
-	_xt += xt_dot*_dt;
-	if (_xt>sqrt(_Emax*2)) _xt=sqrt(_Emax*2);
-	_Et = 0.5*_xt*_xt;
+//$ROS_HOME, ~/.ros by default
+static std::string rosHome() {
+	if(getenv("ROS_HOME")) return getenv("ROS_HOME");
+	return std::string(getenv("HOME") ? getenv("HOME") : ".") + "/.ros";
 }
 
+bool KUKA_INVDYN::init_robot_model() {
+	//URDF from robot_description, or from ~urdf_file when the node runs without it
+	ros::NodeHandle& pnh = _pnh;
 
-class DERIV {
-	public:
-		DERIV(double freq=500,double gain=100) {_f=freq;_dt=1.0/_f;_integral=Eigen::VectorXd::Zero(6);_gain=gain;};
-		void update(Eigen::VectorXd x) {_xd=_gain*(x-_integral); _integral+=_gain*_dt*(x-_integral);};
-
-		Eigen::VectorXd _xd;
-	private:
-		double _f,_dt;
-		Eigen::VectorXd _integral;
-		double _gain;
-
-};
-
-enum diverterState {IMPACT, DETACHED, HOOKED, NORMAL};
-
-class KUKA_INVDYN {
-	public:
-		KUKA_INVDYN(double sampleTime);
-		void run();
-		bool init_robot_model();
-		void get_dirkin();
-
-		void joint_states_cb( sensor_msgs::JointState );
-		void interaction_wrench_cb(const gazebo_msgs::ContactsStateConstPtr&);
-		void real_interaction_wrench_cb(const geometry_msgs::WrenchStampedConstPtr&);
-		void drone_posfb_cb(const std_msgs::Float64MultiArrayConstPtr& message);
-		void ctrl_loop();
-		void compute_force_errors(const Eigen::VectorXd h, const Eigen::VectorXd hdot, const Eigen::VectorXd mask);
-		void compute_errors(const geometry_msgs::PoseStamped& p_des, const geometry_msgs::TwistStamped& v_des, const geometry_msgs::AccelStamped& a_des);
-		void compute_compliantFrame(const geometry_msgs::PoseStamped& p_des, const geometry_msgs::TwistStamped& v_des, const geometry_msgs::AccelStamped& a_des);
-		void compute_compliantFrame(const geometry_msgs::PoseStamped& p_des, const geometry_msgs::TwistStamped& v_des, const geometry_msgs::AccelStamped& a_des, const std::vector<double> alpha);
-		bool newTrajectory(const std::vector<geometry_msgs::PoseStamped> waypoints, const std::vector<double> times);
-		bool newTrajectory(const std::vector<geometry_msgs::PoseStamped> waypoints, const std::vector<double> times, const Eigen::VectorXd xdi, const Eigen::VectorXd xdf, const Eigen::VectorXd xddi, const Eigen::VectorXd xddf);
-		bool newForceTrajectory(const std::vector<Eigen::VectorXd> waypoints, const std::vector<double> times, const Eigen::VectorXd mask);
-		bool getPose(geometry_msgs::PoseStamped& p_des);
-		bool getDesPose(geometry_msgs::PoseStamped& p_des);
-		bool getWrench(Eigen::VectorXd& _wrench);
-		bool robotReady() {return _first_fk;};
-		void exitForceControl() {_fControl=false;};
-		const diverterState getState() {return _state;};
-		void actionCB(const kuka_control::waypointsGoalConstPtr &goal);
-		void setDone(bool done) {_mainDone=done;};
-	private:
-		void updatePose();
-		void updateForce();
-		void updateState();
-		ros::NodeHandle _nh;
-		KDL::Tree iiwa_tree;
-
-		KDL::ChainFkSolverPos_recursive *_fksolver; //Forward position solver
-		KDL::ChainFkSolverVel_recursive *_fk_solver_pos_vel; //Forward position and velocity solver
-		KDL::ChainIkSolverVel_pinv *_ik_solver_vel;   	//Inverse velocity solver
-		KDL::ChainIkSolverPos_NR *_ik_solver_pos;
-		KDL::ChainJntToJacSolver *_J_solver;
-		KDL::ChainJntToJacDotSolver *_Jdot_solver;
-
-		KDL::Chain _k_chain;
-
-		ros::Subscriber _js_sub;
-		ros::Publisher _js_pub;
-		ros::Subscriber _wrench_sub, _real_wrench_sub, _dronePosFb_sub;
-		ros::Publisher _cartpose_pub, _cartvel_pub, _desPose_pub, _extWrench_pub, _linearDifference_pub, _linearVelDifference_pub;
-		ros::Publisher _plannedpose_pub,_plannedtwist_pub,_plannedacc_pub,_plannedwrench_pub;
-		ros::Publisher _robotEnergy_pub, _totalEnergy_pub, _tankEnergy_pub, _totalPower_pub, _kpvalue_pub, _kdvalue_pub;
-		KDL::JntArray *_initial_q;
-		KDL::JntArray *_q_in;
-		KDL::JntArray *_q_out;
-		KDL::JntArray *_q_in_old;
-		KDL::JntArray *_dq_in;
-		ros::Publisher _cmd_pub[7];
-		bool _first_js;
-		bool _first_fk;
-		bool _sync, _first_wrench;
-		KDL::FrameVel _dirkin_out;
-		KDL::Frame _p_out;
-		KDL::Twist _v_out;
-		KDL::ChainDynParam *_dyn_param;
-		geometry_msgs::PoseStamped _pose;
-		geometry_msgs::TwistStamped _vel;
-		Eigen::VectorXd _acc;
-		Eigen::VectorXd x_t;
-		Eigen::VectorXd xDot_t;
-		Eigen::VectorXd xDotDot;
-		Eigen::MatrixXd _J;
-		Eigen::MatrixXd _Jold;
-		Eigen::MatrixXd _JDot;
-		Eigen::VectorXd _gradManMeas;
-		Eigen::VectorXd _extWrench, _wrenchBias;
-		int _wrenchCount;
-		Eigen::VectorXd z_t,zDot_t,zDotDot_t;
-		geometry_msgs::PoseStamped _complPose;
-		geometry_msgs::TwistStamped _complVel;
-		geometry_msgs::AccelStamped _complAcc;
-		geometry_msgs::PoseStamped _desPose;
-		geometry_msgs::TwistStamped _desVel;
-		geometry_msgs::AccelStamped _desAcc;
-		bool _fControl;
-		bool _trajEnd;
-		bool _newPosReady;
-		geometry_msgs::PoseStamped _nextdesPose;
-		geometry_msgs::TwistStamped _nextdesVel;
-		geometry_msgs::AccelStamped _nextdesAcc;
-		Eigen::MatrixXd _Mt;
-		Eigen::MatrixXd _Kdt;
-		Eigen::MatrixXd _Kpt;
-		Eigen::VectorXd xf,xf_dot,xf_dotdot;
-		Eigen::VectorXd _h_des,_hdot_des, _nexth_des,_nexthdot_des, _forceMask;
-		DERIV numericAcc;
-		double _sTime,_freq;
-		actionlib::SimpleActionServer<kuka_control::waypointsAction> _kukaActionServer;
-		kuka_control::waypointsFeedback _actionFeedback;
-  		kuka_control::waypointsResult _actionResult;
-		LowPassFilter lpf[6];
-		double _admittanceEnergy, _forcesEnergy, _contTime;
-		diverterState _state;
-		bool _firstCompliant, _mainDone, _dronePos_ready;
-		Eigen::Vector3d _dronePos;
-};
+	//Arm model: ~model, or iiwa_model set by the launch file
+	std::string model;
+	_nh.param<std::string>("iiwa_model", model, "iiwa7");
+	pnh.param<std::string>("model", model, model);
+	_useGenKin = _genKin.select(model);
+	_modelName = model;
 
-bool KUKA_INVDYN::init_robot_model() {
-	/*
+	//Only the iiwa7 URDF ships expanded with the package: the others need robot_description or ~urdf_file
 	std::string robot_desc_string;
-	_nh.param("robot_description", robot_desc_string, std::string());
-	if (!kdl_parser::treeFromString(robot_desc_string, iiwa_tree)){
-		ROS_ERROR("Failed to construct kdl tree");
-		return false;
-	}
-	else {
-		ROS_INFO("Robot tree found!");
+	if(!_nh.getParam("robot_description", robot_desc_string)) {
+		std::string urdfFile;
+		std::string pkgPath = ros::package::getPath("kuka_control");
+		pnh.param<std::string>("urdf_file", urdfFile, (model == "iiwa7" && pkgPath != "") ? pkgPath + "/urdf/iiwa7.urdf" : "");
+		if(urdfFile == "") {
+			ROS_ERROR("No robot_description and no ~urdf_file for %s", model.c_str());
+			return false;
+		}
+		std::ifstream in(urdfFile.c_str());
+		if(!in) {
+			ROS_ERROR("No robot_description and cannot read %s", urdfFile.c_str());
+			return false;
+		}
+		robot_desc_string.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
 	}
-	*/
-
-    if (!kdl_parser::treeFromFile("/home/jcacace/dev/ros_ws/src/IIWA/iiwa_admittance/urdf/iiwa7.urdf", iiwa_tree)){
-    	ROS_ERROR("Failed to construct kdl tree");
-      	return false;
-    }
 
-	std::string base_link = "iiwa_link_0";
-	std::string tip_link  = "iiwa_link_sensor_kuka";
+	std::string base_link = _useGenKin ? _genKin.base : "iiwa_link_0";
+	std::string tip_link  = _useGenKin ? _genKin.tip : "iiwa_link_sensor_kuka";
+	pnh.param<std::string>("tip_link", tip_link, tip_link);
 	//std::string base_link = "world";
 	//std::string tip_link  = "lbr_iiwa_link_7";
-	if ( !iiwa_tree.getChain(base_link, tip_link, _k_chain) ) return false;
+	if(!_model.init(robot_desc_string, base_link, tip_link, rosHome())) {
+		ROS_ERROR("Failed to construct kdl chain");
+		return false;
+	}
+	_k_chain = _model.chain();
+	_jsMap.setJointNames(_model.jointNames());
+	if(_model.fromCache()) ROS_INFO("Kinematic model mapped from %s", _model.cacheFile().c_str());
+	else ROS_INFO("Kinematic model parsed, cached in %s", _model.cacheFile().c_str());
 
 	_fksolver = new KDL::ChainFkSolverPos_recursive( _k_chain );
 	_fk_solver_pos_vel = new KDL::ChainFkSolverVel_recursive( _k_chain );
@@ -304,28 +98,129 @@ bool KUKA_INVDYN::init_robot_model() {
 	_q_in_old = new KDL::JntArray( _k_chain.getNrOfJoints() );
 	_dq_in = new KDL::JntArray( _k_chain.getNrOfJoints() );
 	_initial_q = new KDL::JntArray( _k_chain.getNrOfJoints() );
-	_dyn_param = new KDL::ChainDynParam(_k_chain,KDL::Vector(0,0,-9.81));
+	if(!_dyn.init(_k_chain)) ROS_WARN("Chain not supported by ARM_DYNAMICS, torque mode not available");
+
+	//The generated code is built from the package xacro: it must describe the same chain as robot_description
+	if(_useGenKin && (tip_link != _genKin.tip || _k_chain.getNrOfJoints() != 7)) _useGenKin = false;
+	for(int k=0; _useGenKin && k<10; k++) {
+		double q[7];
+		for(int i=0; i<7; i++) {
+			q[i] = M_PI*(2.0*rand()/RAND_MAX - 1.0);
+			(*_q_in)(i) = q[i];
+		}
+		KDL::Frame F;
+		Eigen::Matrix3d R;
+		Eigen::Vector3d p;
+		_fksolver->JntToCart(*_q_in, F);
+		_genKin.fk(q, R, p);
+		Eigen::Matrix3d Rk = Eigen::Map<const Eigen::Matrix<double,3,3,Eigen::RowMajor> >(F.M.data);
+		if((p-Eigen::Vector3d(F.p.x(),F.p.y(),F.p.z())).norm() > 1e-6 || (R-Rk).norm() > 1e-6)
+			_useGenKin = false;
+	}
+	_q_in->data.setZero();
+	if(_useGenKin) ROS_INFO("Generated kinematics for %s -> %s", model.c_str(), tip_link.c_str());
+	else ROS_WARN("No generated kinematics matching %s -> %s, using KDL solvers", model.c_str(), tip_link.c_str());
 
 	return true;
 }
 
-KUKA_INVDYN::KUKA_INVDYN(double sampleTime) :
-    _kukaActionServer(_nh, "kukaActionServer", boost::bind(&KUKA_INVDYN::actionCB, this, _1), false) {
+KUKA_INVDYN::KUKA_INVDYN(ros::NodeHandle& nh, ros::NodeHandle& pnh, double sampleTime) :
+    _nh(nh), _pnh(pnh), _kukaActionServer(_nh, "kukaActionServer", boost::bind(&KUKA_INVDYN::actionCB, this, _1), false) {
 
+	_startTime = ros::WallTime::now();
+	ASYNC_LOG::instance(); //drain thread started here, not on the first record of the control loop
+	_firstCmd = false;
+	_stop = false;
 	_sTime=sampleTime;
 	_freq = 1.0/_sTime;
+}
 
-	if (!init_robot_model()) exit(1);
-	ROS_INFO("Robot tree correctly loaded from parameter server!");
+//Parameters, model, sensors and robot interface; false, with the reason logged, when the controller cannot run
+bool KUKA_INVDYN::init() {
+	ros::NodeHandle& pnh = _pnh;
+
+	if (!init_robot_model()) return false;
+	ROS_INFO("Robot model loaded in %f s", (ros::WallTime::now()-_startTime).toSec());
+
+	cout << "Joints and segments: " << _k_chain.getNrOfJoints() << " - " << _k_chain.getNrOfSegments() << endl;
+
+	std::string reachMapFile;
+	pnh.param<std::string>("reachability_map", reachMapFile, "");
+	pnh.param("seed_jump_tresh", _seedJumpTresh, 0.05);
+	pnh.param("max_seed_joint_step", _maxSeedStep, M_PI/4.0);
+	if(reachMapFile != "") {
+		//Seeds of another arm or tool frame would send the IK to the wrong branch
+		std::string tip = _k_chain.getSegment(_k_chain.getNrOfSegments()-1).getName();
+		if(!_reachMap.load(reachMapFile))
+			ROS_WARN("Cannot read reachability map %s, IK seeded from the last command only", reachMapFile.c_str());
+		else if(!_reachMap.matches(_modelName, tip, ROBOT_MODEL::chainHash(_k_chain))) {
+			ROS_WARN("Reachability map %s built for %s -> %s or another chain, not %s -> %s: IK seeded from the last command only",
+			         reachMapFile.c_str(), _reachMap.model().c_str(), _reachMap.tip().c_str(), _modelName.c_str(), tip.c_str());
+			_reachMap.unload();
+		}
+		else
+			ROS_INFO("Reachability map loaded: %s", reachMapFile.c_str());
+	}
 
-	cout << "Joints and segments: " << iiwa_tree.getNrOfJoints() << " - " << iiwa_tree.getNrOfSegments() << endl;
+	std::string sdfFile;
+	pnh.param<std::string>("distance_field", sdfFile, "");
+	pnh.param("sdf_clearance", _sdfClearance, 0.05);
+	if(sdfFile != "") {
+		if(_sdf.load(sdfFile))
+			ROS_INFO("Workspace distance field loaded: %s", sdfFile.c_str());
+		else {
+			ROS_ERROR("Cannot load workspace distance field %s", sdfFile.c_str());
+			return false;
+		}
+	}
 
+	double selfCollisionMargin;
+	pnh.param("self_collision", _selfCollisionCheck, true);
+	pnh.param("self_collision_margin", selfCollisionMargin, 0.01);
+	//Without capsules for the arm model the link checks are off, the tip is still projected out of the distance field
+	std::vector<LINK_CAPSULE> capsules;
+	if(!modelCapsules(_modelName, capsules))
+		ROS_WARN("No link capsules for %s: self-collision and link distance checks disabled", _modelName.c_str());
+	else if(!_capsules.init(_k_chain, "iiwa_link_0", capsules))
+		ROS_WARN("Link capsules of %s do not match the kinematic chain: self-collision and link distance checks disabled", _modelName.c_str());
+	if(_capsules.size() == 0)
+		_selfCollisionCheck = false;
+	else {
+		//Pairs touching with the arm stretched are not monitored
+		_selfCollision.init(_capsules, KDL::JntArray(_k_chain.getNrOfJoints()), 2, selfCollisionMargin);
+		ROS_INFO("Self-collision: %d link pairs monitored", _selfCollision.size());
+	}
+
+	//The tip is projected to _sdfClearance, the capsule around the last link ends there: with less than its
+	//radius every command at a forbidden region would be vetoed by command_clear
+	if(_sdf.isLoaded() && _capsules.size() > 0) {
+		double sdfMargin, tipClearance;
+		pnh.param("sdf_margin", sdfMargin, 0.02);
+		tipClearance = _capsules.radius(_capsules.size()-1) + sdfMargin;
+		if(_sdfClearance < tipClearance) {
+			ROS_WARN("sdf_clearance %f within the %s capsule, raised to %f", _sdfClearance, _capsules.capsule(_capsules.size()-1).link.c_str(), tipClearance);
+			_sdfClearance = tipClearance;
+		}
+	}
+
+	//position: IK on the compliant frame, torque: inverse dynamics tracking of the compliant frame
+	std::string controlMode;
+	pnh.param<std::string>("control_mode", controlMode, "position");
+	_torqueMode = (controlMode == "torque");
+	if(_torqueMode && !_dyn.isReady()) {
+		ROS_ERROR("Torque mode needs the arm dynamics");
+		return false;
+	}
+	//Off when the robot side already compensates gravity, as the FRI torque overlay does
+	pnh.param("torque_gravity", _torqueGravity, true);
+	pnh.param("torque_kp", _torqueKp, 400.0);
+	pnh.param("torque_kd", _torqueKd, 2.0*sqrt(_torqueKp));
+	pnh.param("null_damping", _nullDamping, 2.0);
+	pnh.param("dynamics_budget", _dynBudget, 0.25*_sTime);
+	pnh.param("max_budget_overruns", _maxBudgetOverruns, 10);
+	_budgetOverruns = 0;
+	ROS_INFO("Control mode: %s", _torqueMode ? "torque" : "position");
 
-	_js_sub = _nh.subscribe("/iiwa/joint_states", 0, &KUKA_INVDYN::joint_states_cb, this);
-	_js_pub = _nh.advertise<std_msgs::Float64MultiArray>("/iiwa/jointsCommand", 0);
-	_wrench_sub = _nh.subscribe("/tool_contact_sensor_state", 0, &KUKA_INVDYN::interaction_wrench_cb, this);
-	_real_wrench_sub = _nh.subscribe("/netft_data", 0, &KUKA_INVDYN::real_interaction_wrench_cb, this);
-	_dronePosFb_sub = _nh.subscribe("/controller/posFeedback", 0, &KUKA_INVDYN::drone_posfb_cb, this);
 
 	_cartpose_pub = _nh.advertise<geometry_msgs::PoseStamped>("/iiwa/eef_pose", 0);
 	_cartvel_pub = _nh.advertise<geometry_msgs::TwistStamped>("/iiwa/eef_twist", 0);
@@ -372,24 +267,87 @@ KUKA_INVDYN::KUKA_INVDYN(double sampleTime) :
 	xf_dot.resize(6); xf_dot=Eigen::VectorXd::Zero(6);
 	xf_dotdot.resize(6); xf_dotdot=Eigen::VectorXd::Zero(6);
 
-	_Mt =  1*Eigen::MatrixXd::Identity(6,6); //1
-	_Kdt = 15*Eigen::MatrixXd::Identity(6,6); //15
-	_Kpt = 13*Eigen::MatrixXd::Identity(6,6); //10
-
-	//_Mt.bottomRightCorner(3,3) = 70*Eigen::MatrixXd::Identity(3,3);
-	//_Kpt.bottomRightCorner(3,3) = 1000*Eigen::MatrixXd::Identity(3,3);
-	//_Mt(1,1) = 3;
-	//_Kdt(1,1) = 150;
-	//_Kpt(1,1) = 30; 
+	_Mt.setConstant(1); //1
+	_Kdt.setConstant(15); //15
+	_Kpt.setConstant(13); //10
+
+	//_Mt.tail(3).setConstant(70);
+	//_Kpt.tail(3).setConstant(1000);
+	//_Mt(1) = 3;
+	//_Kdt(1) = 150;
+	//_Kpt(1) = 30; 
+
+	//zoh: exact for the wrench held over a tick, stable at any stiffness. euler: the original integration
+	std::string integrator;
+	pnh.param<std::string>("admittance_integrator", integrator, "zoh");
+	_admittance.setSampleTime(_sTime);
+	_admittance.setIntegrator(integrator == "euler" ? EULER : ZOH);
+
+	//Joint states differentiated at their own rate: FRI rate when the arm streams them
+	double jointStateRate;
+	pnh.param("joint_state_rate", jointStateRate, _freq);
+	numericAcc = DERIV(jointStateRate);
+
+	//The controller stops when a window of ticks misses the budget at the given percentile
+	pnh.param("budget_check_ticks", _budgetCheckTicks, 10000);
+	pnh.param("tick_budget", _tickBudget, _sTime);
+	pnh.param("budget_percentile", _budgetPercentile, 99.9);
+	_tickTimes.init(1e-6, 10*_tickBudget);
+	_budgetFailed = false;
+
+	pnh.param("supervisor_rate", _supervisorFreq, 50.0);
+	if(_supervisorFreq > _freq) _supervisorFreq = _freq;
 
 	_wrenchCount = 0;
-	_wrenchBias = Eigen::VectorXd::Zero(6);
+	_wrenchBias.setZero();
+	_Re.setIdentity();
+	_pe.setZero();
+	//Sensor stream decimated to one wrench per control tick, then smoothed at the control rate
+	//Stop band where the aliases of the control rate fold above the cutoff, and never above the sensor Nyquist
+	//frequency: with a sensor slower than the loop (1 kHz FRI rate) the decimator only interpolates
+	//The design is refused when its delay exceeds wrench_max_delay, by default three control periods
+	double ftRate, wrenchCutoff, wrenchMaxDelay;
+	pnh.param("ft_rate", ftRate, 500.0);
+	pnh.param("wrench_max_delay", wrenchMaxDelay, 3.0*_sTime);
+	double defaultCutoff = 0.25*std::min(_freq, ftRate);
+	pnh.param("wrench_cutoff", wrenchCutoff, defaultCutoff);
+	if(wrenchCutoff >= std::min(_freq-wrenchCutoff, 0.5*ftRate)) {
+		ROS_WARN("wrench_cutoff %f too high for ft_rate %f and control rate %f, using %f", wrenchCutoff, ftRate, _freq, defaultCutoff);
+		wrenchCutoff = defaultCutoff;
+	}
+	if(!_wrenchDecimator.init(ftRate, wrenchCutoff, std::min(_freq-wrenchCutoff, 0.5*ftRate), wrenchMaxDelay)) {
+		ROS_ERROR("Invalid wrench decimation: ft_rate %f, wrench_cutoff %f, control rate %f, or delay above wrench_max_delay %f s",
+			ftRate, wrenchCutoff, _freq, wrenchMaxDelay);
+		return false;
+	}
+	ROS_INFO("Wrench decimator: Butterworth order %d, %f s delay", _wrenchDecimator.getOrder(), _wrenchDecimator.getDelay());
+	_wrenchFilter.firstOrder(_sTime, 5.0/(2.0*M_PI));
+
+	//Sensor offsets and tool payload from the last run; without them the first 500 samples are averaged
+	double ftRebiasTime;
+	pnh.param<std::string>("ft_calibration", _ftCalibFile, rosHome() + "/iiwa_ft_calibration.txt");
+	pnh.param("ft_rebias", _ftRebias, true);
+	pnh.param("ft_rebias_time", ftRebiasTime, 20.0);
+	pnh.param("ft_static_joint_vel", _ftStaticVel, 0.02);
+	//Residuals above the gates are contacts, not offsets: well below the 0.5 N of the contact detection
+	pnh.param("ft_rebias_force_gate", _ftForceGate, 0.2);
+	pnh.param("ft_rebias_torque_gate", _ftTorqueGate, 0.02);
+	//Updates are kept only if no contact follows within this time
+	pnh.param("ft_rebias_settle_time", _ftSettleTime, 2.0);
+	_ftFree.store(false);
+	_ftPendingTime = -1;
+	_ftCalib.setForgetting(1.0 - 1.0/(ftRate*ftRebiasTime));
+	if(_ftCalib.load(_ftCalibFile))
+		ROS_INFO("F/T calibration loaded from %s: tool mass %f kg", _ftCalibFile.c_str(), _ftCalib.mass());
+	else
+		ROS_WARN("No F/T calibration in %s: biasing on the first samples, keep the tool free", _ftCalibFile.c_str());
+	_ftCalibClean = _ftCalib;
+	_dronePosFilter.firstOrder(_sTime, 30.0/(2.0*M_PI));
 
 
 	_h_des.resize(6); _h_des=Eigen::VectorXd::Zero(6);
 	_hdot_des.resize(6); _hdot_des=Eigen::VectorXd::Zero(6);
 	_acc.resize(6);_acc=Eigen::VectorXd::Zero(6);
-	_dronePos = Eigen::Vector3d::Zero();
 
 	_admittanceEnergy = 0;
 	_state = NORMAL;
@@ -402,38 +360,84 @@ KUKA_INVDYN::KUKA_INVDYN(double sampleTime) :
 	_first_wrench = false;
 	_firstCompliant = false;
 	_mainDone = false;
+	_firstIk = false;
+	_safeFrameValid = false;
 
 	_contTime=0;
 
+	//mailbox: state streams keep their last sample and the F/T queue holds a few ticks of samples (the
+	//decimator needs them all). queue: unbounded queues. The control thread always takes the latest joint state
+	std::string ingestion;
+	pnh.param<std::string>("state_ingestion", ingestion, "mailbox");
+	_mailbox = (ingestion != "queue");
+	int stateQueue = _mailbox ? 1 : 0;
+	int ftQueue = 0;
+	if(_mailbox) pnh.param("ft_queue_size", ftQueue, std::max(1, (int)ceil(4*ftRate*_sTime)));
+	pnh.param("ingestion_report", _ingestionReport, 10.0);
+	_ftSeqValid = false;
+	ROS_INFO("State ingestion: %s", _mailbox ? "mailbox" : "queue");
+
+	//Each sensor stream on its own queue and thread; the action server stays on the global queue
+	bool streamThreads;
+	pnh.param("stream_threads", streamThreads, true);
+	_ftSpinner.init("ft", _nh, pnh, streamThreads);
+	_contactSpinner.init("contacts", _nh, pnh, streamThreads);
+	_droneSpinner.init("drone", _nh, pnh, streamThreads);
+
+	//ros: joint states and commands on the rosToFri topics. shm: shared memory segment of the FRI bridge
+	std::string transport, robot;
+	pnh.param<std::string>("command_transport", transport, "ros");
+	pnh.param<std::string>("robot_interface", robot, transport);
+	if(robot == "shm")
+		_robot.reset(new SHM_ROBOT);
+	else
+		_robot.reset(new ROS_ROBOT(stateQueue, streamThreads, _model.jointNames()));
+	if(!_robot->init(_nh, pnh)) {
+		ROS_ERROR("Robot interface %s not available", robot.c_str());
+		return false;
+	}
+	_wrench_sub = _contactSpinner.subscribe<gazebo_msgs::ContactsState>(_nh, "/tool_contact_sensor_state", stateQueue, boost::bind(&KUKA_INVDYN::interaction_wrench_cb, this, _1));
+	_real_wrench_sub = _ftSpinner.subscribe<geometry_msgs::WrenchStamped>(_nh, "/netft_data", ftQueue, boost::bind(&KUKA_INVDYN::real_interaction_wrench_cb, this, _1), ros::TransportHints().tcpNoDelay());
+	_dronePosFb_sub = _droneSpinner.subscribe<std_msgs::Float64MultiArray>(_nh, "/controller/posFeedback", stateQueue, boost::bind(&KUKA_INVDYN::drone_posfb_cb, this, _1));
+	_ftSpinner.start();
+	_contactSpinner.start();
+	_droneSpinner.start();
+
 	_kukaActionServer.start();
+	return true;
 }
 
 void KUKA_INVDYN::drone_posfb_cb(const std_msgs::Float64MultiArrayConstPtr& message) {
-	_dronePos(0) = message->data[0];
-	_dronePos(1) = message->data[1];
-	_dronePos(2) = message->data[2];
-
-	_dronePos_ready = true;
+	if(message->data.size() < 3) {
+		ALOG_WARN(1.0, "Drone position feedback with %lu values, 3 expected", (unsigned long)message->data.size());
+		return;
+	}
+	DRONE_SNAPSHOT drone;
+	for(int i=0; i<3; i++) drone.p[i] = message->data[i];
+	_droneSnapshot.write(drone);
 }
 
 bool KUKA_INVDYN::getPose(geometry_msgs::PoseStamped& p_des) {
 	if(!_first_fk) return false;
 
-	p_des = _pose;
+	pose2Msg(_pose, p_des.pose);
+	p_des.header.stamp = _poseStamp;
 	return true;
 }
 
 bool KUKA_INVDYN::getDesPose(geometry_msgs::PoseStamped& p_des) {
 	if(!_first_fk) return false;
 
-	p_des = _desPose;
+	pose2Msg(_desPose, p_des.pose);
 	return true;
 }
 
+//Wrench of the last control tick
 bool KUKA_INVDYN::getWrench(Eigen::VectorXd& wrench) {
-	if(!_first_fk) return false;
+	LOOP_SNAPSHOT loop;
+	if(!_loopSnapshot.read(loop)) return false;
 
-	wrench = _extWrench;
+	wrench = Eigen::Map<const Eigen::Matrix<double,6,1>>(loop.wrench);
 	return true;
 }
 
@@ -441,36 +445,26 @@ void KUKA_INVDYN::interaction_wrench_cb(const gazebo_msgs::ContactsStateConstPtr
 
 	int nContacts=message->states.size();
 
+	//Handed to the control loop, which owns _extWrench
+	WRENCH_SNAPSHOT contact;
+	Eigen::Map<Eigen::Matrix<double,6,1>> wrench(contact.w);
 	if(nContacts==0) {
-		_extWrench = Eigen::VectorXd::Zero(6);
+		wrench.setZero();
 	}
 	else {
-		for (int i=0; i<nContacts; i++) {
-			_extWrench(0)=message->states[i].total_wrench.force.x;
-			_extWrench(1)=message->states[i].total_wrench.force.y;
-			_extWrench(2)=message->states[i].total_wrench.force.z;
-			_extWrench(3)=message->states[i].total_wrench.torque.x;
-			_extWrench(4)=message->states[i].total_wrench.torque.y;
-			_extWrench(5)=message->states[i].total_wrench.torque.z;
-		}
-		tf::Quaternion qe(_pose.pose.orientation.x,_pose.pose.orientation.y,_pose.pose.orientation.z,_pose.pose.orientation.w);
-		tf::Matrix3x3 Re_tf;
-		Eigen::Matrix3d Re;
-		Re_tf.setRotation(qe);
-		tf::matrixTFToEigen(Re_tf,Re);
-		_extWrench.head(3) = Re*_extWrench.head(3);
-		_extWrench.tail(3) = Re*_extWrench.tail(3);
+		ARM_SNAPSHOT arm;
+		Eigen::Matrix3d Re = Eigen::Matrix3d::Identity();
+		if(_armSnapshot.read(arm)) Re = Eigen::Map<const Eigen::Matrix3d>(arm.Re);
+		wrench = vectorView(message->states[nContacts-1].total_wrench);
+		wrench.head(3) = Re*wrench.head(3);
+		wrench.tail(3) = Re*wrench.tail(3);
 		geometry_msgs::WrenchStamped wrenchstamp;
 		wrenchstamp.header.stamp = ros::Time::now();
-		wrenchstamp.wrench.force.x = _extWrench(0);
-		wrenchstamp.wrench.force.y = _extWrench(1);
-		wrenchstamp.wrench.force.z = _extWrench(2);
-		wrenchstamp.wrench.torque.x = _extWrench(3);
-		wrenchstamp.wrench.torque.y = _extWrench(4);
-		wrenchstamp.wrench.torque.z = _extWrench(5);
+		vectorView(wrenchstamp.wrench) = wrench;
 		_extWrench_pub.publish(wrenchstamp);
 		//cout<<_extWrench<<endl<<endl;
 	}
+	_contactWrench.write(contact);
 
 	_first_wrench=true;
 
@@ -478,90 +472,144 @@ void KUKA_INVDYN::interaction_wrench_cb(const gazebo_msgs::ContactsStateConstPtr
 
 void KUKA_INVDYN::real_interaction_wrench_cb(const geometry_msgs::WrenchStampedConstPtr& message) {
 	
-	Eigen::VectorXd localWrench, outWrench;
+	Eigen::Matrix<double,6,1> localWrench = vectorView(message->wrench);
 	int nSamples = 500;
-	localWrench.resize(6);
-	outWrench.resize(6);
-
-	localWrench(0)=message->wrench.force.x;
-	localWrench(1)=message->wrench.force.y;
-	localWrench(2)=message->wrench.force.z;
-	localWrench(3)=message->wrench.torque.x;
-	localWrench(4)=message->wrench.torque.y;
-	localWrench(5)=message->wrench.torque.z;
-
-	if(_wrenchCount<nSamples) {
-		_wrenchBias += localWrench;
-		_wrenchCount++;
-		return;
-	}
-	else if (_wrenchCount==nSamples) {
+
+	if(!_ftCalib.isValid()) {
+		if(_wrenchCount<nSamples) {
+			_wrenchBias += localWrench;
+			_wrenchCount++;
+			return;
+		}
 		_wrenchBias/=_wrenchCount;
-		_wrenchCount++;
-		ROS_WARN("Force biased!");
-		cout<<_wrenchBias.transpose()<<endl;
+		_ftCalib.reset(_wrenchBias);
+		_ftCalibMutex.lock();
+		_ftCalibClean = _ftCalib;
+		_ftCalibMutex.unlock();
+		ALOG_WARN(0, "Force biased: %f %f %f %f %f %f", _wrenchBias(0), _wrenchBias(1), _wrenchBias(2), _wrenchBias(3), _wrenchBias(4), _wrenchBias(5));
 	}
-	
-	for(int i=0; i<6; i++)
-		localWrench(i) -= _wrenchBias(i);
 
-	outWrench = localWrench;
+	//Gravity in the sensor frame; offsets and payload are tracked while the arm is still and free:
+	//a sustained contact would otherwise be absorbed into the bias
+	//The arm state is the snapshot of the last control tick, nothing before the first one
+	ARM_SNAPSHOT arm;
+	bool armValid = _armSnapshot.read(arm);
+	Eigen::Matrix3d Re = Eigen::Matrix3d::Identity();
+	if(armValid) Re = Eigen::Map<const Eigen::Matrix3d>(arm.Re);
+	Eigen::Vector3d g = Re.transpose()*Eigen::Vector3d(0,0,-9.81);
+	//Sensor timestamp, arrival time if the driver does not stamp
+	ros::Time now = ros::Time::now();
+	ros::Time stamp = message->header.stamp.isZero() ? now : message->header.stamp;
+
+	if(_ftRebias) {
+		bool contact = !_ftFree.load();
+		if(!contact && armValid && (arm.qdNorm < _ftStaticVel)) {
+			bool wasTrusted = _ftCalib.isTrusted();
+			contact = !_ftCalib.update(localWrench, g, _ftForceGate, _ftTorqueGate);
+			if(!wasTrusted && _ftCalib.isTrusted())
+				ALOG_INFO(0, "F/T payload identified: %f kg", _ftCalib.mass());
+		}
+		checkpoint_ft_calibration(stamp.toSec(), contact);
+	}
+	localWrench -= _ftCalib.predict(g);
 
-	for (int i=0; i<6; i++) {
-		//cout<<lpf[i].update(localWrench(i),0.002,100.0/(2.0*M_PI))<<"  real:"<<localWrench(i)<<endl;
-		localWrench(i) = lpf[i].update(localWrench(i),0.002,5.0/(2.0*M_PI));
+	_wrenchMutex.lock();
+	_ftStats.received++;
+	if(_ftSeqValid && message->header.seq > _ftSeq+1)
+		_ftStats.dropped += message->header.seq - _ftSeq - 1;
+	_ftSeq = message->header.seq;
+	_ftSeqValid = true;
+	_wrenchDecimator.push(localWrench, stamp.toSec());
+	_wrenchMutex.unlock();
+
+	_first_wrench=true;
+}
+
+//One anti-aliased sensor wrench per control tick, filtered and moved to the base frame
+void KUKA_INVDYN::update_wrench(const ros::Time& tick) {
+	Eigen::Matrix<double,6,1> localWrench, outWrench;
+
+	_wrenchMutex.lock();
+	bool ready = _wrenchDecimator.output(tick.toSec(), localWrench);
+	if(ready) _ftStats.sample(_wrenchDecimator.age(tick.toSec())); //newest sample, when the tick uses it
+	_wrenchMutex.unlock();
+	if(!ready) {
+		//No F/T sensor: the simulated contact wrench, when there is one
+		WRENCH_SNAPSHOT contact;
+		if(_contactWrench.read(contact)) _extWrench = Eigen::Map<const Eigen::Matrix<double,6,1>>(contact.w);
+		return;
 	}
-	//cout<<endl;
-
-	tf::Quaternion qe(_pose.pose.orientation.x,_pose.pose.orientation.y,_pose.pose.orientation.z,_pose.pose.orientation.w);
-    Vector3d pe(_pose.pose.position.x,_pose.pose.position.y,_pose.pose.position.z);
-    tf::Matrix3x3 Re_tf;
-    Eigen::Matrix3d Re;
-    Re_tf.setRotation(qe);
-    tf::matrixTFToEigen(Re_tf,Re);
-    MatrixXd staticTransf(6,6);
-    staticTransf << Re, MatrixXd::Zero(3,3),
-                    Skew(pe)*Re, Re;
-    localWrench = staticTransf*localWrench;
-    outWrench = staticTransf*outWrench;
-	outWrench = localWrench;
+
+	localWrench = _wrenchFilter.update(localWrench);
+
+	//Sensor to base frame: [Re 0; Skew(pe)*Re Re], applied by blocks
+	outWrench.head<3>() = _Re*localWrench.head<3>();
+	outWrench.tail<3>() = _pe.cross(outWrench.head<3>()) + _Re*localWrench.tail<3>();
+
 	geometry_msgs::WrenchStamped wrenchstamp;
-	wrenchstamp.header.stamp = ros::Time::now();
-	wrenchstamp.wrench.force.x = outWrench(0);
-	wrenchstamp.wrench.force.y = outWrench(1);
-	wrenchstamp.wrench.force.z = outWrench(2);
-	wrenchstamp.wrench.torque.x = outWrench(3);
-	wrenchstamp.wrench.torque.y = outWrench(4);
-	wrenchstamp.wrench.torque.z = outWrench(5);
-
-	_extWrench = localWrench;
-	
+	wrenchstamp.header.stamp = tick;
+	vectorView(wrenchstamp.wrench) = outWrench;
+
+	_extWrench = outWrench;
+
 	//Eigen::Vector3d S(0.0,0.0,0.1); //braccio
 	//_extWrench.tail(3) = Skew(S) * _extWrench.head(3) + _extWrench.tail(3);
 
 	if(outWrench.norm()<1000)
 		_extWrench_pub.publish(wrenchstamp);
+}
 
-	if((_extWrench.norm()<1000) && _firstCompliant && (zDot_t.norm()!=0)) {
-		//cout<<"calcolo"<<endl;	
-		//_forcesEnergy += zDot_t.head(3).dot(_extWrench.head(3)) * (1.0/500.0);
-		//double totalPower = zDot_t.dot(_extWrench);
+//A contact creeps in below the gates before it is detected: the updates of the last settle time
+//are held back, and dropped when a contact episode starts. Only the clean estimate is saved
+void KUKA_INVDYN::checkpoint_ft_calibration(double t, bool contact) {
+	if(contact) {
+		if(_ftPendingTime >= 0) {
+			_ftCalibMutex.lock();
+			_ftCalib = _ftCalibClean;
+			_ftCalibMutex.unlock();
+			ALOG_INFO(1.0, "F/T contact: calibration updates of the last %f s dropped", t - _ftPendingTime);
+		}
+		_ftPendingTime = -1;
+		return;
+	}
+	if(_ftPendingTime < 0) {
+		_ftCalibPending = _ftCalib;
+		_ftPendingTime = t;
 	}
+	else if(t - _ftPendingTime > _ftSettleTime) {
+		_ftCalibMutex.lock();
+		_ftCalibClean = _ftCalibPending;
+		_ftCalibMutex.unlock();
+		_ftCalibPending = _ftCalib;
+		_ftPendingTime = t;
+	}
+}
 
-	_first_wrench=true;
+void KUKA_INVDYN::saveFtCalibration() {
+	boost::mutex::scoped_lock lock(_ftCalibMutex);
+	if(_ftCalibClean.isTrusted() && _ftCalibClean.save(_ftCalibFile))
+		ROS_INFO("F/T calibration saved to %s", _ftCalibFile.c_str());
 }
 
-void KUKA_INVDYN::joint_states_cb( sensor_msgs::JointState js ) {
+//Blocks until a joint state newer than the last one used has been applied
+void KUKA_INVDYN::wait_joint_states() {
+	sensor_msgs::JointStateConstPtr js = _robot->waitState(_stop);
+	if(js) update_joint_states(*js);
+}
+
+void KUKA_INVDYN::update_joint_states( const sensor_msgs::JointState& js ) {
 	//cout<<"Joint states"<<endl;
-	_q_in_old->data=_q_in->data;
-
-	for(int i=0; i<7; i++ ) {
-		_q_in->data[i] = js.position[i];
-		_dq_in->data[i] = js.velocity[i];
-		if( !_first_js ) {
-			_initial_q->data[i] = js.position[i];
-			_q_out->data[i] = js.position[i];
-		}
+	bool mapped = _jsMap.ready();
+
+	//Other joints sharing the topic (gripper, other arms) are skipped
+	//Gathered into the old array, which becomes the current one only when the message maps onto the chain
+	if(!_jsMap.gather(js, _q_in_old->data.data(), _dq_in->data.data())) return;
+	std::swap(_q_in, _q_in_old);
+	if(!mapped)
+		ALOG_INFO(0, "Joint states: %d chain joints mapped out of %d", (int)_k_chain.getNrOfJoints(), (int)js.position.size());
+	if( !_first_js ) {
+		_initial_q->data = _q_in->data;
+		_q_out->data = _q_in->data;
 	}
 
 	get_dirkin();
@@ -575,28 +623,27 @@ void KUKA_INVDYN::joint_states_cb( sensor_msgs::JointState js ) {
 	}
 
 	_first_js = true;
-	_sync = true;
 }
 
-void KUKA_INVDYN::updateState() {
+void KUKA_INVDYN::updateState(const Eigen::Matrix<double,6,1>& wrench, double dt) {
 	//return;
 	double uptresh = 0.5, imptresh = 3, timetresh = 1.0;
-	bool up_cond = (_extWrench.norm()>uptresh) && (_extWrench.norm()<imptresh);
+	bool up_cond = (wrench.norm()>uptresh) && (wrench.norm()<imptresh);
 	//bool down_cond = _extWrench.norm()<lowtresh;
 
 	//double uptresh = 0.05, lowtresh = 0.03, imptresh = 0.2, timetresh = 1.0;
 	//double lowtresh = 0.02;
 	//bool up_cond = (zDotDot_t.norm()>uptresh) && (zDotDot_t.norm()<imptresh);
-	bool down_cond = ( _extWrench(2)>(-2) ) && ( _extWrench(2)<(-1) );
+	bool down_cond = ( wrench(2)>(-2) ) && ( wrench(2)<(-1) );
 
 	switch(_state) {
         case NORMAL:
           if( up_cond ) {
-			  _contTime += 1.0/_freq;
-			  ROS_WARN("Entrato");
+			  _contTime += dt;
+			  ALOG_WARN(1.0, "Entrato");
 			  if(_contTime>(timetresh*2)) {
 				_state = HOOKED;
-				ROS_WARN("STATE: HOOKED!");
+				ALOG_WARN(0, "STATE: HOOKED!");
 				_contTime = 0;
 			  }
 		  } else
@@ -606,13 +653,13 @@ void KUKA_INVDYN::updateState() {
           break;
         case HOOKED:
           if( down_cond ) {
-			  _contTime += 1.0/_freq;
-			  ROS_WARN("Uscendo");
+			  _contTime += dt;
+			  ALOG_WARN(1.0, "Uscendo");
 			  if(_contTime>(timetresh*4)) {
 				//_state = NORMAL;
 				//ROS_WARN("STATE: NORMAL!");
 				_state = DETACHED;
-				ROS_WARN("STATE: DETACHED!");
+				ALOG_WARN(0, "STATE: DETACHED!");
 				_contTime = 0;
 			  }
           } else {
@@ -621,10 +668,10 @@ void KUKA_INVDYN::updateState() {
           break;
         case DETACHED:
 			if( _trajEnd ) {
-			  _contTime += 1.0/_freq;
+			  _contTime += dt;
 			  if(_contTime>(timetresh*4)) {
 				_state = IMPACT;
-				ROS_WARN("STATE: IMPACT!");
+				ALOG_WARN(0, "STATE: IMPACT!");
 				_contTime = 0;
 			  }
           	} else {
@@ -633,10 +680,10 @@ void KUKA_INVDYN::updateState() {
         	break;
 		case IMPACT:
 			if( _mainDone ) {
-			  _contTime += 1.0/_freq;
+			  _contTime += dt;
 			  if(_contTime>(timetresh*4)) {
 				_state = NORMAL;
-				ROS_WARN("STATE: NORMAL!");
+				ALOG_WARN(0, "STATE: NORMAL!");
 				_contTime = 0;
 			  }
           	} else {
@@ -649,45 +696,34 @@ void KUKA_INVDYN::updateState() {
 void KUKA_INVDYN::ctrl_loop() {
 
 	std_msgs::Float64 cmd[7];
-	std_msgs::Float64MultiArray jcmd;
-	jcmd.data.resize(7);
-  KDL::JntArray coriol_(7);
-  KDL::JntArray grav_(7);
+	ROBOT_COMMAND robotCmd;
 	KDL::JntArray q_out_new(_k_chain.getNrOfJoints());
+	KDL::JntArray q_next(_k_chain.getNrOfJoints());
+	ARM_DYNAMICS::JointVector tau;
 	
 	KDL::JntArray qd_out(_k_chain.getNrOfJoints());
 
-  KDL::JntSpaceInertiaMatrix jsim_;
-  jsim_.resize(_k_chain.getNrOfJoints());
-
 	ros::Rate r(_freq);
 
-	//ETank tank(1.0,0.01,1.0,_sTime);
-	//ETankGen tankGen(3.0,0.01,3.0,_sTime,1);
-	ETankGen stiffnessTank(0.5,0.01,0.5,_sTime,1);
-
-	Eigen::MatrixXd finalKp = 1*_Kpt;
-	Eigen::MatrixXd initialKp = _Kpt;
-	Eigen::MatrixXd KpDot = Eigen::MatrixXd::Zero(6,6);
-	Eigen::MatrixXd finalKd = 3*_Kdt; //4
-	Eigen::MatrixXd initialKd = _Kdt;
-	Eigen::MatrixXd KdDot = Eigen::MatrixXd::Zero(6,6);
-	Eigen::MatrixXd finalM = 3*_Mt; //4
-	Eigen::MatrixXd initialM = _Mt;
-	Eigen::MatrixXd MDot = Eigen::MatrixXd::Zero(6,6);
-	double finalT = 0.5; //transition in 0.5 seconds
+	typedef Eigen::Matrix<double,6,1> Vector6d;
+	typedef Eigen::Map<const Vector6d> GainMap;
+	LOOP_SNAPSHOT loop;
+	GAIN_SNAPSHOT gains;
+	ARM_SNAPSHOT arm;
+	unsigned long gainTick = 0;
+	int gainAge = 0;
+	double tankInput = 0, tankDissipated = 0;
 
 	bool emergencyShut = false;
-	LowPassFilter* dronepos_filter[3];
-	for (int i=0; i<3; i++)
-		dronepos_filter[i] = new LowPassFilter(30.0/(2.0*M_PI),(1.0/_freq));
+	while( !_first_js && !_stop ) wait_joint_states();
+	while( !_first_wrench && !_stop ) usleep(0.1);
 
-	while( !_first_js ) usleep(0.1);
-	while( !_first_wrench ) usleep(0.1);
+	while( ros::ok() && (!emergencyShut) && (!_stop)) {
 
-	while( ros::ok() && (!emergencyShut)) {
+		wait_joint_states();
+		ros::WallTime tickStart = ros::WallTime::now();
 
-    while( !_sync ) usleep(0.1);
+		update_wrench(ros::Time::now());
 
 	/*	if(_fControl) {
 			updateForce();
@@ -697,180 +733,61 @@ void KUKA_INVDYN::ctrl_loop() {
 		*/
 		updatePose();
 
-/*
-		Eigen::VectorXd desVelEigen, desAccEigen, complVelEigen;
-		twist2Vector(_desVel,desVelEigen);
-		accel2Vector(_desAcc,desAccEigen);
-		twist2Vector(_complVel,complVelEigen);
-		std::vector<Eigen::VectorXd> tankInputs, tankProds;
-		std::vector<double> tankDiss;
-		tankDiss.push_back(complVelEigen.transpose()*_Kdt*complVelEigen);
-		tankInputs.push_back(-desVelEigen);
-		tankProds.push_back(_Kpt*z_t);
-		tankInputs.push_back(_Mt*desAccEigen + _Kdt*desVelEigen);
-		tankProds.push_back(complVelEigen);
-		tankGen.update(tankInputs,tankDiss,tankProds);
-		*/
-		//cout<<tankGen.getEt()<<endl;
-
-		//compute_compliantFrame(_desPose,_desVel,_desAcc,tankGen._alpha);
-
-		if( (_state == HOOKED) || (_state == IMPACT) ) {
-			if(_state == HOOKED) {
-				finalKp = 13*Eigen::MatrixXd::Identity(6,6); 
-				finalKd = 2*15*Eigen::MatrixXd::Identity(6,6); //4
-				finalM =  3*1*Eigen::MatrixXd::Identity(6,6); //3
-			}
-			else if(_state == IMPACT) {
-				finalKp = 400*Eigen::MatrixXd::Identity(6,6); 
-				finalKd = 800*Eigen::MatrixXd::Identity(6,6);
-				finalM =  30*Eigen::MatrixXd::Identity(6,6);
-				finalKp(1,1) = 20;
-				finalKd(1,1) = 30;
-				finalM(1,1) = 1;
-			}
-
-			for(int i=0; i<6; i++) {
-				if(_Kpt(i,i)<finalKp(i,i)) {
-					//ROS_WARN("POSITIVA");
-					KpDot(i,i) = ((finalKp(i,i)-initialKp(i,i))/finalT);
-					//_Kpt(i,i) += (finalKp(i,i)/finalT) * _sTime;
-				}
-				else
-					KpDot(i,i) = 0;
-
-				if(_Kdt(i,i)<finalKd(i,i)) {
-					//ROS_WARN("POSITIVA");
-					KdDot(i,i) = ((finalKd(i,i)-initialKd(i,i))/finalT);
-					//_Kpt(i,i) += (finalKp(i,i)/finalT) * _sTime;
-				}
-				else
-					KdDot(i,i) = 0;
-
-				if(_Mt(i,i)<finalM(i,i)) {
-					//ROS_WARN("POSITIVA");
-					MDot(i,i) = ((finalM(i,i)-initialM(i,i))/finalT);
-					//_Kpt(i,i) += (finalKp(i,i)/finalT) * _sTime;
-				}
-				else
-					MDot(i,i) = 0;
-			}
-		}
-		else if( _state == NORMAL || (_state == DETACHED)) {
-			for(int i=0; i<6; i++) {
-				if(_Kpt(i,i)>initialKp(i,i)) {
-					//ROS_WARN("NEGATIVA");
-					//cout<<KpDot(i,i)<< " ";
-					KpDot(i,i) = -((finalKp(i,i)-initialKp(i,i))/finalT);
-					//_Kpt(i,i) -= (finalKp(i,i)/finalT) * _sTime;
-				}
-				else
-					KpDot(i,i) = 0;
-
-				if(_Kdt(i,i)>initialKd(i,i)) {
-					//ROS_WARN("POSITIVA");
-					KdDot(i,i) = -((finalKd(i,i)-initialKd(i,i))/finalT);
-					//_Kpt(i,i) += (finalKp(i,i)/finalT) * _sTime;
-				}
-				else
-					KdDot(i,i) = 0;
-
-				if(_Mt(i,i)>initialM(i,i)) {
-					//ROS_WARN("POSITIVA");
-					MDot(i,i) = -((finalM(i,i)-initialM(i,i))/finalT);
-					//_Kpt(i,i) += (finalKp(i,i)/finalT) * _sTime;
-				}
-				else
-					MDot(i,i) = 0;
+		//Arm state for the sensor callbacks, which run on their own threads
+		Eigen::Map<Eigen::Matrix3d>(arm.Re) = _Re;
+		arm.qdNorm = _dq_in->data.norm();
+		_armSnapshot.write(arm);
+
+		//Gains scheduled by the supervisor, interpolated over its period
+		Vector6d KpPrev = _Kpt, MPrev = _Mt;
+		if(_gainSnapshot.read(gains)) {
+			if(gains.tick != gainTick) {
+				gainTick = gains.tick;
+				gainAge = 0;
 			}
+			double a = std::min(gainAge*_sTime*_supervisorFreq, 1.0);
+			gainAge++;
+			_Mt = GainMap(gains.M[0]) + a*(GainMap(gains.M[1]) - GainMap(gains.M[0]));
+			_Kdt = GainMap(gains.D[0]) + a*(GainMap(gains.D[1]) - GainMap(gains.D[0]));
+			_Kpt = GainMap(gains.K[0]) + a*(GainMap(gains.K[1]) - GainMap(gains.K[0]));
+			//The ZOH matrices are discretized at the ramp ends only, once per supervisor period
+			_admittance.setGains(GainMap(gains.M[0]), GainMap(gains.D[0]), GainMap(gains.K[0]),
+			                     GainMap(gains.M[1]), GainMap(gains.D[1]), GainMap(gains.K[1]), a);
 		}
+		else
+			_admittance.setGains(_Mt,_Kdt,_Kpt);
 
-		std::vector<double> tankInputs;
-		std::vector<double> tankDiss;
-
-		tankDiss.push_back(zDot_t.dot(_Kdt*zDot_t));
-		//Eigen::VectorXd prod = KpDot*z_t;
-		//for(int i=0; i<6; i++) {
-		//	tankInputs.push_back(z_t(i));
-		//	tankProds.push_back(prod(i));
-		//}
-		if (stiffnessTank._alpha[0] != 1)
-			cout<<stiffnessTank._alpha[0] << " " << _Kpt(0,0)<<endl;
-		KpDot *= stiffnessTank._alpha[0];
-		MDot *= stiffnessTank._alpha[0];
-		tankInputs.push_back(0.5*z_t.dot(KpDot*z_t) + 0.5*zDot_t.dot(MDot*zDot_t));
-		stiffnessTank.update(tankInputs,tankDiss);
-	
-		_Kpt += _sTime * KpDot;	
-		_Mt += _sTime * MDot;
-		_Kdt += _sTime * KdDot;
-		if(_Kpt.norm()>finalKp.norm())
-			_Kpt = finalKp;
-		else if(_Kpt.norm()<initialKp.norm())
-			_Kpt = initialKp;
-
-		if(_Kdt.norm()>finalKd.norm())
-			_Kdt = finalKd;
-		else if(_Kdt.norm()<initialKd.norm())
-			_Kdt = initialKd;
-
-		if(_Mt.norm()>finalM.norm())
-			_Mt = finalM;
-		else if(_Mt.norm()<initialM.norm())
-			_Mt = initialM;
-
-		//cout<<_Mt(0,0)<<endl;
-		std_msgs::Float64MultiArray msg;
-		msg.data.resize(3);
-		msg.data[0] = _Kpt(0,0);
-		msg.data[1] = _Kdt(0,0);
-		msg.data[2] = _Mt(0,0);
-		_kpvalue_pub.publish(msg);
-
-		double totalEnergy = _admittanceEnergy - _forcesEnergy + stiffnessTank.getEt();
-		std_msgs::Float64 msgenergy;
-		msgenergy.data = totalEnergy;
-		_totalEnergy_pub.publish(msgenergy);
-		//cout<<KdDot(1,1)<<endl;
-		std_msgs::Float64 msgtank;
-		msgtank.data = stiffnessTank.getEt();
-		_tankEnergy_pub.publish(msgtank);
-
-		_desPose_pub.publish(_desPose);
-		updateState();
 		compute_compliantFrame(_desPose,_desVel,_desAcc);
 		//compute_errors(_complPose,_complVel,_complAcc); //Calcolo errori spazio operativo
 
-		_complPose.header.stamp = ros::Time::now();
-		_complVel.header.stamp = _complPose.header.stamp;
-		_complAcc.header.stamp = _complPose.header.stamp;
-		_plannedpose_pub.publish(_complPose);
-		_plannedtwist_pub.publish(_complVel);
-		_plannedacc_pub.publish(_complAcc);
+		//Stiffness tank port, integrated every tick: energy put in the admittance by the gain changes, and its damping
+		tankInput += 0.5*z_t.dot((_Kpt-KpPrev).cwiseProduct(z_t)) + 0.5*zDot_t.dot((_Mt-MPrev).cwiseProduct(zDot_t));
+		tankDissipated += _sTime*zDot_t.dot(_Kdt.cwiseProduct(zDot_t));
+
+		Eigen::Map<Vector6d>(loop.z) = z_t;
+		Eigen::Map<Vector6d>(loop.zd) = zDot_t;
+		Eigen::Map<Vector6d>(loop.wrench) = _extWrench;
+		pose2Array(_complPose, loop.complPose);
+		pose2Array(_desPose, loop.desPose);
+		Eigen::Map<Vector6d>(loop.complVel) = vectorView(_complVel.twist);
+		Eigen::Map<Vector6d>(loop.complAcc) = vectorView(_complAcc.accel);
+		loop.admittanceEnergy = _admittanceEnergy;
+		loop.forcesEnergy = _forcesEnergy;
+		loop.power = zDot_t.dot(_extWrench) - _admittance.dissipation(zDot_t);
+		loop.tankInput = tankInput;
+		loop.tankDissipated = tankDissipated;
+		_loopSnapshot.write(loop);
 
 		//printf("DesPose: x: %f - y: %f - z: %f\n", _desPose.pose.position.x,_desPose.pose.position.y,_desPose.pose.position.z);
 		//printf("ComplPose: x: %f - y: %f - z: %f\n", _complPose.pose.position.x,_complPose.pose.position.y,_complPose.pose.position.z);
 
 		KDL::Frame F_dest;
-		tf::Quaternion qdes(_complPose.pose.orientation.x,_complPose.pose.orientation.y,_complPose.pose.orientation.z,_complPose.pose.orientation.w);
-		tf::Matrix3x3 R(qdes);
-		F_dest.M.data[0] = R[0][0];
-		F_dest.M.data[1] = R[0][1];
-		F_dest.M.data[2] = R[0][2];
-		F_dest.M.data[3] = R[1][0];
-		F_dest.M.data[4] = R[1][1];
-		F_dest.M.data[5] = R[1][2];
-		F_dest.M.data[6] = R[2][0];
-		F_dest.M.data[7] = R[2][1];
-		F_dest.M.data[8] = R[2][2];
-
-		if(!_dronePos_ready) {
-			F_dest.p.data[0] = _complPose.pose.position.x;
-			F_dest.p.data[1] = _complPose.pose.position.y;
-			F_dest.p.data[2] = _complPose.pose.position.z;
-		} else {
-			Vector3d diff = _dronePos;
-			Vector3d actualPos(_pose.pose.position.x,_pose.pose.position.y,_pose.pose.position.z);
+		pose2Frame(_complPose, F_dest);
+
+		DRONE_SNAPSHOT drone;
+		if(_droneSnapshot.read(drone)) {
+			Vector3d diff(drone.p[0], drone.p[1], drone.p[2]);
+			Vector3d actualPos = _pose.p;
 			Vector3d actualVel;
 			double tresh = 0.02;//1cm
 			for(int i=0; i<3; i++) {
@@ -878,10 +795,7 @@ void KUKA_INVDYN::ctrl_loop() {
 				else if(diff(i)<(-tresh)) diff(i) = (-tresh);
 			}
 
-			actualVel(0) =_pose.pose.position.x-_complPose.pose.position.x-diff(0);
-			actualVel(1) =_pose.pose.position.y-_complPose.pose.position.y-diff(1);
-			actualVel(2) =_pose.pose.position.z-_complPose.pose.position.z-diff(2);
-			actualVel = _freq*actualVel;
+			actualVel = _freq*(_pose.p-_complPose.p-diff);
 			//if (actualVel.norm()>2.0) {
 			//	ROS_ERROR("Emergency shutdown!");
 			//	emergencyShut=true;
@@ -890,37 +804,88 @@ void KUKA_INVDYN::ctrl_loop() {
 			//cout<<"DronePos: "<<diff.transpose()<<endl;
 			//cout<<"Vel: "<<actualVel.norm()<<endl;
 			
-			F_dest.p.data[0] = _complPose.pose.position.x + (dronepos_filter[0]->update(diff(0)) );
-			F_dest.p.data[1] = _complPose.pose.position.y + (dronepos_filter[1]->update(diff(1)) );
-			F_dest.p.data[2] = _complPose.pose.position.z + (dronepos_filter[2]->update(diff(2)) );
-			//for(int i=0; i<3; i++)
-			//	cout<<"real: "<<diff(i)<<" filter: "<<dronepos_filter[i]->getOutput()<<endl;
+			const Vector3d& diffFilt = _dronePosFilter.update(diff);
+			F_dest.p.data[0] = _complPose.p(0) + diffFilt(0);
+			F_dest.p.data[1] = _complPose.p(1) + diffFilt(1);
+			F_dest.p.data[2] = _complPose.p(2) + diffFilt(2);
 			
 		}
 
-		if(F_dest.p.data[1]>0.75) F_dest.p.data[1]=0.75; //workspace saturation
+		if(_sdf.isLoaded()) {
+			Eigen::Vector3d p(F_dest.p.x(),F_dest.p.y(),F_dest.p.z());
+			if(_sdf.projectOut(p,_sdfClearance) > 0)
+				F_dest.p = KDL::Vector(p(0),p(1),p(2));
+		}
+		else if(F_dest.p.data[1]>0.75) F_dest.p.data[1]=0.75; //workspace saturation
 
 
 		//cout<<"joints: ";
 		//for(int i=0; i<7; i++) cout<<_q_out->data[i]<<" ";
 		//cout<<endl;
 
-		if( _ik_solver_pos->CartToJnt(*_q_out, F_dest, q_out_new) != KDL::SolverI::E_NOERROR )
-			cout << "failing in ik!" << endl;
+		if(_torqueMode) {
+			//The position command holds the measured configuration: switching back to IK starts from here
+			_q_out->data = _q_in->data;
+			//The link checks of the position mode, on the configuration expected at the next tick: when it is
+			//not clear the arm goes back to the last measured pose that was, without the feedforward
+			q_next.data = _q_in->data + _sTime*_dq_in->data;
+			bool hold = false;
+			if(command_clear(q_next)) {
+				_safeFrame = _p_out;
+				_safeFrameValid = true;
+			}
+			else if(_safeFrameValid) {
+				F_dest = _safeFrame;
+				hold = true;
+			}
+			if(torque_command(F_dest, hold, tau))
+				_budgetOverruns = 0;
+			else if(++_budgetOverruns >= _maxBudgetOverruns) {
+				ALOG_ERROR(0, "Dynamics over budget for %d ticks: back to position control", _budgetOverruns);
+				_torqueMode = false;
+			}
+		}
 		else {
-			_q_out->data = q_out_new.data;
+			//On a target jump start from the reachability map seed, otherwise from the last command.
+			//The other seed is tried if the first one fails.
+			int ikResult = KDL::SolverI::E_NO_CONVERGE;
+			bool targetJump = _firstIk && ((F_dest.p - _lastF_dest.p).Norm() > _seedJumpTresh);
+			if(targetJump)
+				ikResult = seeded_ik(F_dest, q_out_new);
+			if(ikResult != KDL::SolverI::E_NOERROR)
+				ikResult = _ik_solver_pos->CartToJnt(*_q_out, F_dest, q_out_new);
+			if(ikResult != KDL::SolverI::E_NOERROR && !targetJump)
+				ikResult = seeded_ik(F_dest, q_out_new);
+			_lastF_dest = F_dest;
+			_firstIk = true;
+
+			if( ikResult != KDL::SolverI::E_NOERROR )
+				ALOG_WARN(1.0, "failing in ik!");
+			else if( !command_clear(q_out_new) )
+				ALOG_WARN(1.0, "holding command");
+			else {
+				_q_out->data = q_out_new.data;
 /*
-			cout << "First itr" << endl;
-			for(int i=0; i<7; i++) cout<<q_out_new.data[i]<<" ";
-			cout << endl;
+				cout << "First itr" << endl;
+				for(int i=0; i<7; i++) cout<<q_out_new.data[i]<<" ";
+				cout << endl;
 
-			exit(0);
+				exit(0);
 */
+			}
 		}
 		
 		if(!emergencyShut) {
-			for(int i=0; i<7; i++) jcmd.data[i]=_q_out->data[i];
-			_js_pub.publish(jcmd);
+			for(int i=0; i<7; i++) {
+				robotCmd.q[i] = _q_out->data[i];
+				robotCmd.tau[i] = _torqueMode ? tau(i) : 0.0;
+			}
+			robotCmd.torque = _torqueMode;
+			_robot->sendCommand(robotCmd);
+			if(!_firstCmd) {
+				ALOG_INFO(0, "Cold start: first command %f s after construction", (ros::WallTime::now()-_startTime).toSec());
+				_firstCmd = true;
+			}
 		}
 
 		//for(int i=0; i<7; i++ ) {
@@ -931,113 +896,382 @@ void KUKA_INVDYN::ctrl_loop() {
 		//}
 
 
-		_sync = false;
+		if(_budgetCheckTicks > 0) {
+			_tickTimes.add((ros::WallTime::now()-tickStart).toSec());
+			if(_tickTimes.count() >= (unsigned long)_budgetCheckTicks) {
+				double p = _tickTimes.percentile(_budgetPercentile);
+				if(p > _tickBudget) {
+					ALOG_ERROR(0, "Tick budget check failed: p%g %f s (max %f s) over %f s", _budgetPercentile, p, _tickTimes.max(), _tickBudget);
+					//Only this controller stops: in a nodelet manager the other nodelets keep running
+					_budgetFailed = true;
+					_stop = true;
+				}
+				else
+					ALOG_INFO(0, "Tick budget check: p%g %f s (max %f s) within %f s", _budgetPercentile, p, _tickTimes.max(), _tickBudget);
+				_tickTimes.reset();
+			}
+		}
 
 		r.sleep();
 	}
 
 }
 
-void KUKA_INVDYN::get_dirkin() {
-	KDL::JntArrayVel q_qdot(*_q_in,*_dq_in);
-	_fk_solver_pos_vel->JntToCart(q_qdot, _dirkin_out);
-	_p_out = _dirkin_out.GetFrame();
-	_v_out = _dirkin_out.GetTwist();
-	_pose.pose.position.x = _p_out.p.x();
-	_pose.pose.position.y = _p_out.p.y();
-	_pose.pose.position.z = _p_out.p.z();
+//Supervision at _supervisorFreq on the control loop snapshots: diverter state machine, gain scheduling
+//through the stiffness tank and telemetry. The scheduled gains go back to the control loop as a snapshot
+void KUKA_INVDYN::supervisor_loop() {
+
+	typedef Eigen::Matrix<double,6,1> Vector6d;
+	typedef Eigen::Map<const Vector6d> SnapshotMap;
+	double dt = 1.0/_supervisorFreq;
+	ros::Rate r(_supervisorFreq);
+
+	//ENERGY_TANK<2> tankGen(3.0,0.01,3.0,dt);
+	ENERGY_TANK<1> stiffnessTank(0.5,0.01,0.5,dt);
+	ENERGY_TANK<1>::Ports tankInputs, tankDiss;
+
+	Vector6d Kp = _Kpt, Kd = _Kdt, M = _Mt;
+	Vector6d finalKp = 1*Kp;
+	Vector6d initialKp = Kp;
+	Vector6d KpDot = Vector6d::Zero();
+	Vector6d finalKd = 3*Kd; //4
+	Vector6d initialKd = Kd;
+	Vector6d KdDot = Vector6d::Zero();
+	Vector6d finalM = 3*M; //4
+	Vector6d initialM = M;
+	Vector6d MDot = Vector6d::Zero();
+	double finalT = 0.5; //transition in 0.5 seconds
+	double tankInput = 0, tankDissipated = 0; //control loop sums at the last update
+
+	LOOP_SNAPSHOT loop;
+	GAIN_SNAPSHOT gains;
+	gains.tick = 0;
+	std_msgs::Float64MultiArray msg;
+	msg.data.resize(3);
+	std_msgs::Float64 msgenergy, msgtank;
+	geometry_msgs::PoseStamped desPose, complPose;
+	geometry_msgs::TwistStamped complVel;
+	geometry_msgs::AccelStamped complAcc;
+	geometry_msgs::PointStamped linDiff, linVelDiff;
+	double reportTime = 0;
 
-	
+	while( ros::ok() && !_stop ) {
+
+		if(!_loopSnapshot.read(loop)) {
+			r.sleep();
+			continue;
+		}
+		SnapshotMap z(loop.z), zd(loop.zd), wrench(loop.wrench);
 
-	double qx, qy, qz, qw;
-	_p_out.M.GetQuaternion( qx, qy, qz, qw);
-	//tf::Quaternion quat(qx, qy, qz, qw);
-	//quat.normalize()
-	_pose.pose.orientation.w = qw;
-	_pose.pose.orientation.x = qx;
-	_pose.pose.orientation.y = qy;
-	_pose.pose.orientation.z = qz;
+		updateState(wrench, dt);
+		_ftFree.store(_state == NORMAL && _contTime == 0);
 
-	if(!_first_fk) _desPose = _pose;
+		if( (_state == HOOKED) || (_state == IMPACT) ) {
+			if(_state == HOOKED) {
+				finalKp.setConstant(13); 
+				finalKd.setConstant(2*15); //4
+				finalM.setConstant(3*1); //3
+			}
+			else if(_state == IMPACT) {
+				finalKp.setConstant(400); 
+				finalKd.setConstant(800);
+				finalM.setConstant(30);
+				finalKp(1) = 20;
+				finalKd(1) = 30;
+				finalM(1) = 1;
+			}
+
+			for(int i=0; i<6; i++) {
+				if(Kp(i)<finalKp(i))
+					KpDot(i) = ((finalKp(i)-initialKp(i))/finalT);
+				else
+					KpDot(i) = 0;
+
+				if(Kd(i)<finalKd(i))
+					KdDot(i) = ((finalKd(i)-initialKd(i))/finalT);
+				else
+					KdDot(i) = 0;
+
+				if(M(i)<finalM(i))
+					MDot(i) = ((finalM(i)-initialM(i))/finalT);
+				else
+					MDot(i) = 0;
+			}
+		}
+		else if( _state == NORMAL || (_state == DETACHED)) {
+			for(int i=0; i<6; i++) {
+				if(Kp(i)>initialKp(i))
+					KpDot(i) = -((finalKp(i)-initialKp(i))/finalT);
+				else
+					KpDot(i) = 0;
 
-	_vel.twist.linear.x = _v_out.vel.x();
-	_vel.twist.linear.y = _v_out.vel.y();
-	_vel.twist.linear.z = _v_out.vel.z();
-	_vel.twist.angular.x = _v_out.rot.x();
-	_vel.twist.angular.y = _v_out.rot.y();
-	_vel.twist.angular.z = _v_out.rot.z();
+				if(Kd(i)>initialKd(i))
+					KdDot(i) = -((finalKd(i)-initialKd(i))/finalT);
+				else
+					KdDot(i) = 0;
 
-	KDL::Jacobian Jac(_k_chain.getNrOfJoints());
-	KDL::Jacobian JacDot(_k_chain.getNrOfJoints());
-	if( _J_solver->JntToJac(*_q_in, Jac) != KDL::ChainJntToJacSolver::E_NOERROR )
-		cout << "failing in Jacobian computation!" << endl;
+				if(M(i)>initialM(i))
+					MDot(i) = -((finalM(i)-initialM(i))/finalT);
+				else
+					MDot(i) = 0;
+			}
+		}
 
-	_Jold = _J;
-	_J = Jac.data;
-	if( _Jdot_solver->JntToJacDot(q_qdot, JacDot) != KDL::ChainJntToJacDotSolver::E_NOERROR )
-		cout << "failing in JacobianDot computation!" << endl;
+		//Energy exchanged over the control ticks since the last update, as the mean power of the period
+		tankInputs(0) = (loop.tankInput - tankInput)/dt;
+		tankDiss(0) = (loop.tankDissipated - tankDissipated)/dt;
+		tankInput = loop.tankInput;
+		tankDissipated = loop.tankDissipated;
+		stiffnessTank.update(tankInputs,tankDiss);
+		if (stiffnessTank.getAlpha(0) != 1)
+			ALOG_INFO(0.5, "Stiffness tank alpha %f, Kp %f", stiffnessTank.getAlpha(0), Kp(0));
+		KpDot *= stiffnessTank.getAlpha(0);
+		MDot *= stiffnessTank.getAlpha(0);
+
+		Eigen::Map<Vector6d>(gains.M[0]) = M;
+		Eigen::Map<Vector6d>(gains.D[0]) = Kd;
+		Eigen::Map<Vector6d>(gains.K[0]) = Kp;
+		Kp += dt * KpDot;	
+		M += dt * MDot;
+		Kd += dt * KdDot;
+		if(Kp.norm()>finalKp.norm())
+			Kp = finalKp;
+		else if(Kp.norm()<initialKp.norm())
+			Kp = initialKp;
+
+		if(Kd.norm()>finalKd.norm())
+			Kd = finalKd;
+		else if(Kd.norm()<initialKd.norm())
+			Kd = initialKd;
+
+		if(M.norm()>finalM.norm())
+			M = finalM;
+		else if(M.norm()<initialM.norm())
+			M = initialM;
+		Eigen::Map<Vector6d>(gains.M[1]) = M;
+		Eigen::Map<Vector6d>(gains.D[1]) = Kd;
+		Eigen::Map<Vector6d>(gains.K[1]) = Kp;
+		gains.tick++;
+		_gainSnapshot.write(gains);
+
+		msg.data[0] = Kp(0);
+		msg.data[1] = Kd(0);
+		msg.data[2] = M(0);
+		_kpvalue_pub.publish(msg);
 
-	_JDot = JacDot.data;
+		msgenergy.data = loop.admittanceEnergy - loop.forcesEnergy + stiffnessTank.getEt();
+		_totalEnergy_pub.publish(msgenergy);
+		msgtank.data = stiffnessTank.getEt();
+		_tankEnergy_pub.publish(msgtank);
+		msgenergy.data = loop.admittanceEnergy;
+		_robotEnergy_pub.publish(msgenergy);
+		msgenergy.data = loop.power;
+		_totalPower_pub.publish(msgenergy);
+
+		array2Pose(loop.desPose, desPose);
+		_desPose_pub.publish(desPose);
+
+		array2Pose(loop.complPose, complPose);
+		vectorView(complVel.twist) = SnapshotMap(loop.complVel);
+		vectorView(complAcc.accel) = SnapshotMap(loop.complAcc);
+		complPose.header.stamp = ros::Time::now();
+		complVel.header.stamp = complPose.header.stamp;
+		complAcc.header.stamp = complPose.header.stamp;
+		_plannedpose_pub.publish(complPose);
+		_plannedtwist_pub.publish(complVel);
+		_plannedacc_pub.publish(complAcc);
+
+		linDiff.header.stamp = complPose.header.stamp;
+		linVelDiff.header.stamp = linDiff.header.stamp;
+		linDiff.point.x = z(0);
+		linDiff.point.y = z(1);
+		linDiff.point.z = z(2);
+		linVelDiff.point.x = zd(0);
+		linVelDiff.point.y = zd(1);
+		linVelDiff.point.z = zd(2);
+		_linearDifference_pub.publish(linDiff);
+		_linearVelDifference_pub.publish(linVelDiff);
+
+		reportTime += dt;
+		if(_ingestionReport > 0 && reportTime >= _ingestionReport) {
+			report_ingestion();
+			reportTime = 0;
+		}
+
+		r.sleep();
+	}
+}
+
+//Samples lost or coalesced and their age when used, callback latencies, since the previous report
+void KUKA_INVDYN::report_ingestion() {
+	_ftSpinner.publishStats();
+	_contactSpinner.publishStats();
+	_droneSpinner.publishStats();
+
+	_robot->report();
+
+	_wrenchMutex.lock();
+	STREAM_STATS ft = _ftStats;
+	_ftStats.reset();
+	_wrenchMutex.unlock();
+
+	if(ft.received == 0) return;
+	if(ft.dropped > 0)
+		ROS_WARN("F/T: %lu samples dropped, %lu received, age %.3f ms mean %.3f ms max", ft.dropped, ft.received, 1e3*ft.meanAge(), 1e3*ft.maxAge);
+	else
+		ROS_DEBUG("F/T: %lu received, age %.3f ms mean %.3f ms max", ft.received, 1e3*ft.meanAge(), 1e3*ft.maxAge);
+}
+
+int KUKA_INVDYN::seeded_ik(const KDL::Frame& F_dest, KDL::JntArray& q_out_new) {
+	if(!_reachMap.isLoaded())
+		return KDL::SolverI::E_NO_CONVERGE;
+
+	const float* s = _reachMap.seed(F_dest);
+	if(!s) return KDL::SolverI::E_NO_CONVERGE;
+
+	KDL::JntArray q_seed(_k_chain.getNrOfJoints());
+	for(unsigned int i=0; i<_k_chain.getNrOfJoints(); i++)
+		q_seed(i) = s[i];
+
+	int res = _ik_solver_pos->CartToJnt(q_seed, F_dest, q_out_new);
+	if(res != KDL::SolverI::E_NOERROR) return res;
+
+	//Solutions in a far away branch would make the joint command jump
+	for(unsigned int i=0; i<_k_chain.getNrOfJoints(); i++)
+		if(fabs(q_out_new(i) - _q_out->data[i]) > _maxSeedStep)
+			return KDL::SolverI::E_NO_CONVERGE;
+
+	return res;
+}
+
+//Joint torques tracking F_dest and the compliant frame velocity and acceleration, with the
+//measured wrench compensated; with hold, F_dest at rest. False when the computation exceeded the tick budget
+bool KUKA_INVDYN::torque_command(const KDL::Frame& F_dest, bool hold, ARM_DYNAMICS::JointVector& tau) {
+	ros::WallTime start = ros::WallTime::now();
+
+	ARM_DYNAMICS::JointVector q = _q_in->data, qd = _dq_in->data;
+	ARM_DYNAMICS::JointMatrix M;
+	ARM_DYNAMICS::JointVector c, g;
+	_dyn.compute(q, qd, M, c, g);
+
+	Eigen::Matrix<double,6,7> J = _J, JDot = _JDot;
+	Eigen::Matrix3d Rd = Eigen::Map<const Eigen::Matrix<double,3,3,Eigen::RowMajor> >(F_dest.M.data);
+	Eigen::AngleAxisd eo(Rd*_Re.transpose());
+	Eigen::Matrix<double,6,1> e;
+	e << F_dest.p.x()-_pe(0), F_dest.p.y()-_pe(1), F_dest.p.z()-_pe(2), eo.angle()*eo.axis();
+
+	Eigen::VectorXd vd, ad;
+	twist2Vector(_complVel, vd);
+	accel2Vector(_complAcc, ad);
+	if(hold) {
+		vd.setZero();
+		ad.setZero();
+	}
+	Eigen::Matrix<double,6,1> a = ad + _torqueKd*(vd - J*qd) + _torqueKp*e - JDot*qd;
+
+	//Damped pseudo-inverse, redundancy damped in the null space
+	Eigen::Matrix<double,7,6> Jpinv = J.transpose()*(J*J.transpose() + 1e-4*Eigen::Matrix<double,6,6>::Identity()).ldlt().solve(Eigen::Matrix<double,6,6>::Identity());
+	ARM_DYNAMICS::JointVector qdd = Jpinv*a - _nullDamping*(ARM_DYNAMICS::JointMatrix::Identity() - Jpinv*J)*qd;
+
+	Eigen::Matrix<double,6,1> h = _extWrench;
+	tau = M*qdd + c - J.transpose()*h;
+	if(_torqueGravity) tau += g;
+	for(int i=0; i<7; i++)
+		if(_model.effort()[i] > 0) tau(i) = std::max(-_model.effort()[i], std::min(_model.effort()[i], tau(i)));
+
+	double elapsed = (ros::WallTime::now()-start).toSec();
+	if(elapsed > _dynBudget) {
+		ALOG_WARN(1.0, "Torque computation %f s over the %f s budget", elapsed, _dynBudget);
+		return false;
+	}
+	return true;
+}
+
+//Vetoes IK solutions with colliding links or links in forbidden regions of the distance field
+bool KUKA_INVDYN::command_clear(const KDL::JntArray& q) {
+	if(!_selfCollisionCheck && (!_sdf.isLoaded() || _capsules.size() == 0)) return true;
+	_capsules.update(q);
+
+	int worst;
+	if(_selfCollisionCheck && _selfCollision.check(_capsules,&worst) < 0) {
+		ALOG_WARN(1.0, "self-collision: %s - %s", _capsules.capsule(_selfCollision.first(worst)).link.c_str(), _capsules.capsule(_selfCollision.second(worst)).link.c_str());
+		return false;
+	}
+
+	if(_sdf.isLoaded()) {
+		//iiwa_link_0 and iiwa_link_1 never leave the base: start from iiwa_link_2
+		for(int i=2; i<_capsules.size(); i++)
+			if(_sdf.capsuleDistance(_capsules.a(i),_capsules.b(i),_capsules.radius(i)) < 0) {
+				ALOG_WARN(1.0, "%s in forbidden region", _capsules.capsule(i).link.c_str());
+				return false;
+			}
+	}
+	return true;
+}
+
+void KUKA_INVDYN::get_dirkin() {
+	if(_useGenKin) {
+		Eigen::Matrix<double,6,7> J, JDot;
+		_genKin.compute(_q_in->data.data(), _dq_in->data.data(), _Re, _pe, J, JDot);
+		_Jold = _J;
+		_J = J;
+		_JDot = JDot;
+		Eigen::Map<Eigen::Matrix<double,3,3,Eigen::RowMajor> >(_p_out.M.data) = _Re;
+		_p_out.p = KDL::Vector(_pe(0), _pe(1), _pe(2));
+	}
+	else {
+		KDL::JntArrayVel q_qdot(*_q_in,*_dq_in);
+		_fk_solver_pos_vel->JntToCart(q_qdot, _dirkin_out);
+		_p_out = _dirkin_out.GetFrame();
+		_pe << _p_out.p.x(), _p_out.p.y(), _p_out.p.z();
+		_Re = Eigen::Map<const Eigen::Matrix<double,3,3,Eigen::RowMajor> >(_p_out.M.data);
+
+		KDL::Jacobian Jac(_k_chain.getNrOfJoints());
+		KDL::Jacobian JacDot(_k_chain.getNrOfJoints());
+		if( _J_solver->JntToJac(*_q_in, Jac) != KDL::ChainJntToJacSolver::E_NOERROR )
+			ALOG_WARN(1.0, "failing in Jacobian computation!");
+
+		_Jold = _J;
+		_J = Jac.data;
+		if( _Jdot_solver->JntToJacDot(q_qdot, JacDot) != KDL::ChainJntToJacDotSolver::E_NOERROR )
+			ALOG_WARN(1.0, "failing in JacobianDot computation!");
+
+		_JDot = JacDot.data;
+	}
 /*	for(int i=0; i<6;i++)
 		for(int j=0; j<7; j++) {
 			_JDot(i,j) = (_J(i,j)-_Jold(i,j))*_freq;
 		} */
 
+	_pose.p = _pe;
+	_pose.q = Eigen::Quaterniond(_Re);
+
+	if(!_first_fk) _desPose = _pose;
+
 	Eigen::VectorXd vel(6);
 	vel = _J*(_dq_in->data);
 	numericAcc.update(vel);
 	_acc = numericAcc._xd;
 
-	_vel.twist.linear.x = vel(0);
-	_vel.twist.linear.y = vel(1);
-	_vel.twist.linear.z = vel(2);
-	_vel.twist.angular.x = vel(3);
-	_vel.twist.angular.y = vel(4);
-	_vel.twist.angular.z = vel(5);
+	vectorView(_vel.twist) = vel;
 
-	_pose.header.stamp = ros::Time::now();
-	_vel.header.stamp = _pose.header.stamp;
-	_cartpose_pub.publish( _pose );
+	geometry_msgs::PoseStamped pose;
+	pose2Msg(_pose, pose.pose);
+	_poseStamp = ros::Time::now();
+	pose.header.stamp = _poseStamp;
+	_vel.header.stamp = _poseStamp;
+	_cartpose_pub.publish( pose );
 	_cartvel_pub.publish( _vel );
 	_first_fk = true;
 }
 
-void KUKA_INVDYN::compute_errors(const geometry_msgs::PoseStamped& p_des, const geometry_msgs::TwistStamped& v_des, const geometry_msgs::AccelStamped& a_des) {
-	x_t(0) = _pose.pose.position.x - p_des.pose.position.x;
-	x_t(1) = _pose.pose.position.y - p_des.pose.position.y;
-	x_t(2) = _pose.pose.position.z - p_des.pose.position.z;
-
-	x_t = -1*x_t; //inverti segno
-
-	tf::Quaternion qe(_pose.pose.orientation.x,_pose.pose.orientation.y,_pose.pose.orientation.z,_pose.pose.orientation.w);
-	tf::Quaternion qd(p_des.pose.orientation.x,p_des.pose.orientation.y,p_des.pose.orientation.z,p_des.pose.orientation.w);
-	tf::Matrix3x3 Re_tf, Rd_tf;
-	Eigen::Matrix3d Re,Rd;
-	Re_tf.setRotation(qe);
-	Rd_tf.setRotation(qd);
-	tf::matrixTFToEigen(Re_tf,Re);
-	tf::matrixTFToEigen(Rd_tf,Rd);
-
-	Eigen::Matrix3d Rerr = Re.transpose()*Rd;
-	tf::Matrix3x3 Rerr_tf;
-	tf::matrixEigenToTF(Rerr,Rerr_tf);
-	tf::Quaternion qerr;
-	Rerr_tf.getRotation(qerr);
-	double angle = qerr.getAngle();
-	tf::Vector3 axis = qerr.getAxis();
-	Eigen::Vector3d eps;
-	tf::vectorTFToEigen(axis,eps);
-	eps = Re*(sin(angle/2.0)*eps);
-	x_t(3) = eps(0);x_t(4) = eps(1);x_t(5) = eps(2);
+void KUKA_INVDYN::compute_errors(const POSE& p_des, const geometry_msgs::TwistStamped& v_des, const geometry_msgs::AccelStamped& a_des) {
+	x_t.head(3) = p_des.p - _pose.p;
+	x_t.tail(3) = orientationError(_pose.q, p_des.q);
 
 	//cout<<x_t<<endl<<endl;
 
-	xDot_t(0) = _vel.twist.linear.x - v_des.twist.linear.x;
-	xDot_t(1) = _vel.twist.linear.y - v_des.twist.linear.y;
-	xDot_t(2) = _vel.twist.linear.z - v_des.twist.linear.z;
-	xDot_t(3) = _vel.twist.angular.x - v_des.twist.angular.x;
-	xDot_t(4) = _vel.twist.angular.y - v_des.twist.angular.y;
-	xDot_t(5) = _vel.twist.angular.z - v_des.twist.angular.z;
+	xDot_t = vectorView(_vel.twist) - vectorView(v_des.twist);
 /*
 	xDot_t(0) += v_des.twist.linear.x;
 	xDot_t(1) +=v_des.twist.linear.y;
@@ -1048,147 +1282,73 @@ void KUKA_INVDYN::compute_errors(const geometry_msgs::PoseStamped& p_des, const
 */
 	xDot_t = -1*xDot_t; //inverti segno
 
-	xDotDot(0) = a_des.accel.linear.x;
-	xDotDot(1) = a_des.accel.linear.y;
-	xDotDot(2) = a_des.accel.linear.z;
-	xDotDot(3) = a_des.accel.angular.x;
-	xDotDot(4) = a_des.accel.angular.y;
-	xDotDot(5) = a_des.accel.angular.z;
+	xDotDot = vectorView(a_des.accel);
 
 }
 
-void KUKA_INVDYN::compute_compliantFrame(const geometry_msgs::PoseStamped& p_des, const geometry_msgs::TwistStamped& v_des, const geometry_msgs::AccelStamped& a_des, const std::vector<double> alpha) {
+void KUKA_INVDYN::compute_compliantFrame(const POSE& p_des, const geometry_msgs::TwistStamped& v_des, const geometry_msgs::AccelStamped& a_des, const std::vector<double> alpha) {
 	geometry_msgs::TwistStamped vmod_des;
 	geometry_msgs::AccelStamped amod_des;
 
 	if (alpha.size()<2) {
-		vmod_des.twist.linear.x = alpha[0]*v_des.twist.linear.x;
-		vmod_des.twist.linear.y = alpha[0]*v_des.twist.linear.y;
-		vmod_des.twist.linear.z = alpha[0]*v_des.twist.linear.z;
-		vmod_des.twist.angular.x = alpha[0]*v_des.twist.angular.x;
-		vmod_des.twist.angular.y = alpha[0]*v_des.twist.angular.y;
-		vmod_des.twist.angular.z = alpha[0]*v_des.twist.angular.z;
+		vectorView(vmod_des.twist) = alpha[0]*vectorView(v_des.twist);
 	}
 	else {
 		double alphaMin = alpha[0]*alpha[1];//min(alpha[0],alpha[1]);
-		vmod_des.twist.linear.x = alphaMin*v_des.twist.linear.x;
-		vmod_des.twist.linear.y = alphaMin*v_des.twist.linear.y;
-		vmod_des.twist.linear.z = alphaMin*v_des.twist.linear.z;
-		vmod_des.twist.angular.x = alphaMin*v_des.twist.angular.x;
-		vmod_des.twist.angular.y = alphaMin*v_des.twist.angular.y;
-		vmod_des.twist.angular.z = alphaMin*v_des.twist.angular.z;
-
-		amod_des.accel.linear.x = alpha[1]*a_des.accel.linear.x;
-		amod_des.accel.linear.y = alpha[1]*a_des.accel.linear.y;
-		amod_des.accel.linear.z = alpha[1]*a_des.accel.linear.z;
-		amod_des.accel.angular.x = alpha[1]*a_des.accel.angular.x;
-		amod_des.accel.angular.y = alpha[1]*a_des.accel.angular.y;
-		amod_des.accel.angular.z = alpha[1]*a_des.accel.angular.z;
-		cout<<"alpha2: "<<alpha[1]<<endl;
+		vectorView(vmod_des.twist) = alphaMin*vectorView(v_des.twist);
+		vectorView(amod_des.accel) = alpha[1]*vectorView(a_des.accel);
+		ALOG_DEBUG(0.5, "alpha2: %f", alpha[1]);
 	}
 
 	compute_compliantFrame(p_des,vmod_des,amod_des);
 }
 
-void KUKA_INVDYN::compute_compliantFrame(const geometry_msgs::PoseStamped& p_des, const geometry_msgs::TwistStamped& v_des, const geometry_msgs::AccelStamped& a_des) {
+void KUKA_INVDYN::compute_compliantFrame(const POSE& p_des, const geometry_msgs::TwistStamped& v_des, const geometry_msgs::AccelStamped& a_des) {
 
 	//cout<<_extWrench<<endl;
 	//cout<<_Kdt<<endl;
 	//cout<<_Kpt<<endl;
 	if(!(_extWrench.norm()<1000000))
 		_extWrench = Eigen::VectorXd::Zero(6);
-	zDotDot_t = _Mt.inverse() * ( _extWrench - _Kdt*zDot_t - _Kpt*z_t);
-	//cout<<_Mt(1,1)<<endl;
-	zDotDot_t.tail(3) = Eigen::VectorXd::Zero(3);
+	//cout<<_Mt(1)<<endl;
 	//cout<<zDotDot_t.transpose()<<endl;
-	//zDotDot_t = Eigen::VectorXd::Zero(6);
-	if(!_first_wrench) {
+	if(_first_wrench) {
+		Eigen::Matrix<double,6,1> zdd, zd = zDot_t, z = z_t;
+		_admittance.step(_extWrench,zdd,zd,z);
+		//No rotational compliance: the angular part keeps its previous motion
+		zdd.tail(3).setZero();
+		zd.tail(3) = zDot_t.tail(3);
+		z.tail(3) = z_t.tail(3) + zDot_t.tail(3)*_sTime;
+		zDotDot_t = zdd;
+		zDot_t = zd;
+		z_t = z;
+	}
+	else {
 		zDotDot_t = Eigen::VectorXd::Zero(6);
+		z_t += zDot_t*_sTime;
 	}
-	zDot_t += zDotDot_t*_sTime;
-	z_t += zDot_t*_sTime;
-	//cout<<z_t.transpose()<<endl;
 
-	geometry_msgs::PointStamped linDiff, linVelDiff;
-	linDiff.header.stamp = ros::Time::now();
-	linVelDiff.header.stamp = linDiff.header.stamp;
-	linDiff.point.x = z_t(0);
-	linDiff.point.y = z_t(1);
-	linDiff.point.z = z_t(2);
-	linVelDiff.point.x = zDot_t(0);
-	linVelDiff.point.y = zDot_t(1);
-	linVelDiff.point.z = zDot_t(2);
-	_linearDifference_pub.publish(linDiff);
-	_linearVelDifference_pub.publish(linVelDiff);
-
-	_complAcc.accel.linear.x = a_des.accel.linear.x + zDotDot_t(0);
-	_complAcc.accel.linear.y = a_des.accel.linear.y + zDotDot_t(1);
-	_complAcc.accel.linear.z = a_des.accel.linear.z + zDotDot_t(2);
-	_complAcc.accel.angular.x = a_des.accel.angular.x + zDotDot_t(3);
-	_complAcc.accel.angular.y = a_des.accel.angular.y + zDotDot_t(4);
-	_complAcc.accel.angular.z = a_des.accel.angular.z + zDotDot_t(5);
-
-	_complVel.twist.linear.x = v_des.twist.linear.x + zDot_t(0);
-	_complVel.twist.linear.y = v_des.twist.linear.y + zDot_t(1);
-	_complVel.twist.linear.z = v_des.twist.linear.z + zDot_t(2);
-	_complVel.twist.angular.x = v_des.twist.angular.x + zDot_t(3);
-	_complVel.twist.angular.y = v_des.twist.angular.y + zDot_t(4);
-	_complVel.twist.angular.z = v_des.twist.angular.z + zDot_t(5);
-
-	_complPose.pose.position.x = p_des.pose.position.x + z_t(0);
-	_complPose.pose.position.y = p_des.pose.position.y + z_t(1);
-	_complPose.pose.position.z = p_des.pose.position.z + z_t(2);
-
-	tf::Quaternion qe(p_des.pose.orientation.x,p_des.pose.orientation.y,p_des.pose.orientation.z,p_des.pose.orientation.w);
-	tf::Quaternion qd(p_des.pose.orientation.x,p_des.pose.orientation.y,p_des.pose.orientation.z,p_des.pose.orientation.w);
-	tf::Matrix3x3 Re_tf, Rd_tf;
-	Eigen::Matrix3d Re,Rd;
-	Re_tf.setRotation(qe);
-	//Rd_tf.setRotation(qd);
-	tf::matrixTFToEigen(Re_tf,Re);
-	//	tf::matrixTFToEigen(Rd_tf,Rd);
-	Eigen::Vector3d eps;
-	eps << z_t(3),z_t(4),z_t(5);
-	eps = Re.transpose()*eps;
-	double eta = sqrt(1-eps(0)*eps(0)-eps(1)*eps(1)-eps(2)*eps(2));
-	if(eta>1) eta=1;
-	else if (eta<-1) eta=-1;
-	double theta = 2*acos(eta);
-	if(theta!=0) { //qd actually different from qe
-		Eigen::Vector3d axis = (1.0/sin(theta*0.5))*eps;
-		tf::Vector3 axis_tf;
-		tf::vectorEigenToTF(axis,axis_tf);
-		tf::Quaternion qerr(axis_tf,theta);
-		tf::Matrix3x3 Rerr_tf(qerr);
-		Eigen::Matrix3d Rerr;
-		tf::matrixTFToEigen(Rerr_tf,Rerr);
-		Rd = Re*Rerr;
-		tf::matrixEigenToTF(Rd,Rd_tf);
-		Rd_tf.getRotation(qd);
+	//Project the compliant displacement out of forbidden regions, dropping the velocity towards them
+	if(_sdf.isLoaded()) {
+		Eigen::Vector3d p = p_des.p + z_t.head(3);
+		Eigen::Vector3d n;
+		if(_sdf.projectOut(p,_sdfClearance,&n) > 0) {
+			z_t.head(3) = p - p_des.p;
+			double vn = zDot_t.head(3).dot(n);
+			if(vn < 0) zDot_t.head(3) -= vn*n;
+		}
 	}
+	//cout<<z_t.transpose()<<endl;
 
-	_complPose.pose.orientation.x = qd.x();
-	_complPose.pose.orientation.y = qd.y();
-	_complPose.pose.orientation.z = qd.z();
-	_complPose.pose.orientation.w = qd.w();
-
-	VectorXd vel;
-	vel.resize(6);
-	vel << _complVel.twist.linear.x ,
-		_complVel.twist.linear.y ,
-		_complVel.twist.linear.z ,
-		_complVel.twist.angular.x,
-		_complVel.twist.angular.y,
-		_complVel.twist.angular.z;
-	//_admittanceEnergy = ((zDot_t.head(3).transpose() * _Mt.topLeftCorner(3,3) * zDot_t.head(3)) + (z_t.head(3).transpose() * _Kpt.topLeftCorner(3,3) * z_t.head(3))).value();
-	_admittanceEnergy = 0.5*zDot_t.dot(_Mt * zDot_t) + 0.5*z_t.dot(_Kpt * z_t);
-	std_msgs::Float64 msg;
-	msg.data = _admittanceEnergy;
+	vectorView(_complAcc.accel) = vectorView(a_des.accel) + zDotDot_t;
+	vectorView(_complVel.twist) = vectorView(v_des.twist) + zDot_t;
+
+	_complPose.p = p_des.p + z_t.head(3);
+	_complPose.q = compliantOrientation(p_des.q, z_t.tail(3));
+
+	//_admittanceEnergy = ((zDot_t.head(3).transpose() * _Mt.head(3).asDiagonal() * zDot_t.head(3)) + (z_t.head(3).transpose() * _Kpt.head(3).asDiagonal() * z_t.head(3))).value();
+	_admittanceEnergy = _admittance.energy(zDot_t,z_t);
 	_forcesEnergy += zDot_t.dot(_extWrench) * _sTime;
-	_robotEnergy_pub.publish(msg);
-	double totalPower = zDot_t.dot(_extWrench) - zDot_t.dot(_Kdt * zDot_t);
-	msg.data = totalPower;
-	_totalPower_pub.publish(msg);
 
 
 	_firstCompliant = true;
@@ -1224,13 +1384,17 @@ bool KUKA_INVDYN::newTrajectory(const std::vector<geometry_msgs::PoseStamped> wa
 
 	int trajsize = cplanner._x.size();
 	int trajpoint = 0;
+	geometry_msgs::PoseStamped nextPose;
 	double status = 0;
 
 	_fControl = false;
 
-	while(cplanner.isReady() && ros::ok()) {
-		while(_newPosReady && ros::ok()) usleep(1);
-		cplanner.getNext(_nextdesPose,_nextdesVel,_nextdesAcc);
+	while(cplanner.isReady() && ros::ok() && !_stop) {
+		//The control thread takes the set point; once stopped nothing will
+		while(_newPosReady && ros::ok() && !_stop) usleep(1);
+		if(_stop) break;
+		cplanner.getNext(nextPose,_nextdesVel,_nextdesAcc);
+		msg2Pose(nextPose.pose,_nextdesPose);
 		_newPosReady=true;
 		trajpoint++;
 		status = 100.0*((double)(trajpoint))/trajsize;
@@ -1276,19 +1440,8 @@ bool KUKA_INVDYN::newForceTrajectory(const std::vector<Eigen::VectorXd> waypoint
 		w[i]->compute_traj();
 	}
 
-	xf(0) = _desPose.pose.position.x;
-	xf(1) = _desPose.pose.position.y;
-	xf(2) = _desPose.pose.position.z;
-	xf(3) = _desPose.pose.orientation.x;
-	xf(4) = _desPose.pose.orientation.y;
-	xf(5) = _desPose.pose.orientation.z;
-	xf(6) = _desPose.pose.orientation.w;
-	xf_dot(0) = _desVel.twist.linear.x;
-	xf_dot(1) = _desVel.twist.linear.y;
-	xf_dot(2) = _desVel.twist.linear.z;
-	xf_dot(3) = _desVel.twist.angular.x;
-	xf_dot(4) = _desVel.twist.angular.y;
-	xf_dot(5) = _desVel.twist.angular.z;
+	pose2Array(_desPose, xf.data());
+	xf_dot = vectorView(_desVel.twist);
 
 	_fControl=true;
 
@@ -1296,7 +1449,7 @@ bool KUKA_INVDYN::newForceTrajectory(const std::vector<Eigen::VectorXd> waypoint
 	int trajpoint = 0;
 	double status = 0;
 
-	while(w[0]->isReady() && ros::ok()) {
+	while(w[0]->isReady() && ros::ok() && !_stop) {
 		Eigen::VectorXd h(6), hdot(6);
 		for(int i=0; i<6; i++) {
 			double f, fdot, fdotdot;
@@ -1304,7 +1457,8 @@ bool KUKA_INVDYN::newForceTrajectory(const std::vector<Eigen::VectorXd> waypoint
 			h(i) = f;
 			hdot(i) = fdot;
 		}
-		while(_newPosReady && ros::ok()) usleep(1);
+		while(_newPosReady && ros::ok() && !_stop) usleep(1);
+		if(_stop) break;
 		_nexth_des=h;
 		_nexthdot_des=hdot;
 		_newPosReady=true;
@@ -1340,23 +1494,12 @@ void KUKA_INVDYN::compute_force_errors(const Eigen::VectorXd h, const Eigen::Vec
 	std_msgs::Float64 data;
 	data.data=ht(1);
 	_plannedwrench_pub.publish(data);
-	cout<<"Error: "<<ht(1)<<" / "<<_extWrench(1)<<endl<<endl;
+	ALOG_INFO(0.5, "Error: %f / %f", ht(1), _extWrench(1));
 	//cout<<ht(1)<<endl<<endl;
-	vel(0) = _complVel.twist.linear.x;
-	vel(1) = _complVel.twist.linear.y;
-	vel(2) = _complVel.twist.linear.z;
-	vel(3) = _complVel.twist.angular.x;
-	vel(4) = _complVel.twist.angular.y;
-	vel(5) = _complVel.twist.angular.z;
-
-	acc(0) = _complAcc.accel.linear.x;
-	acc(1) = _complAcc.accel.linear.y;
-	acc(2) = _complAcc.accel.linear.z;
-	acc(3) = _complAcc.accel.angular.x;
-	acc(4) = _complAcc.accel.angular.y;
-	acc(5) = _complAcc.accel.angular.z;
-
-	xf_dotdot = -_Kdt.inverse()*( -_Kpt*(vel-xf_dot) - Kh*ht + hdot);
+	vel = vectorView(_complVel.twist);
+	acc = vectorView(_complAcc.accel);
+
+	xf_dotdot = -( -_Kpt.cwiseProduct(vel-xf_dot) - Kh*ht + hdot ).cwiseQuotient(_Kdt);
 	//xf_dotdot <<0,xf_dotdot(1),0,0,0,0;
 	for (int i=0; i<6;i++) {
 		if(mask(i)!=0)
@@ -1400,36 +1543,28 @@ void KUKA_INVDYN::compute_force_errors(const Eigen::VectorXd h, const Eigen::Vec
 	}
 
 
-	_nextdesPose.pose.position.x = xf(0);
-	_nextdesPose.pose.position.y = xf(1);
-	_nextdesPose.pose.position.z = xf(2);
-	_nextdesPose.pose.orientation.x = xf(3);
-	_nextdesPose.pose.orientation.y = xf(4);
-	_nextdesPose.pose.orientation.z = xf(5);
-	_nextdesPose.pose.orientation.w = xf(6);
+	_nextdesPose.p = xf.head(3);
+	_nextdesPose.q = Eigen::Quaterniond(xf(6),xf(3),xf(4),xf(5));
 
 	//xf_dot == Eigen::VectorXd::Zero(6);
-	_nextdesVel.twist.linear.x = xf_dot(0);
-	_nextdesVel.twist.linear.y = xf_dot(1);
-	_nextdesVel.twist.linear.z = xf_dot(2);
-	_nextdesVel.twist.angular.x = xf_dot(3);
-	_nextdesVel.twist.angular.y = xf_dot(4);
-	_nextdesVel.twist.angular.z = xf_dot(5);
-
-	_nextdesAcc.accel.linear.x = xf_dotdot(0);
-	_nextdesAcc.accel.linear.y = xf_dotdot(1);
-	_nextdesAcc.accel.linear.z = xf_dotdot(2);
-	_nextdesAcc.accel.angular.x = xf_dotdot(3);
-	_nextdesAcc.accel.angular.y = xf_dotdot(4);
-	_nextdesAcc.accel.angular.z = xf_dotdot(5);
+	vectorView(_nextdesVel.twist) = xf_dot;
+	vectorView(_nextdesAcc.accel) = xf_dotdot;
 
 }
 
 void KUKA_INVDYN::run() {
-	boost::thread ctrl_loop_t( &KUKA_INVDYN::ctrl_loop, this);
+	_ctrlThread = boost::thread( &KUKA_INVDYN::ctrl_loop, this);
+	_supervisorThread = boost::thread( &KUKA_INVDYN::supervisor_loop, this);
 	//ros::spin();
 }
 
+//Ends the control and supervisor threads, for a nodelet being unloaded
+void KUKA_INVDYN::stop() {
+	_stop = true;
+	_ctrlThread.join();
+	_supervisorThread.join();
+}
+
 void KUKA_INVDYN::actionCB(const kuka_control::waypointsGoalConstPtr &goal) {
 	bool result;
 	if(goal->poseOrForce) {
@@ -1471,27 +1606,31 @@ void KUKA_INVDYN::actionCB(const kuka_control::waypointsGoalConstPtr &goal) {
 	}
 }
 
+//Sleeps in short steps: false when the controller is stopped first
+bool KUKA_INVDYN::wait_for(double seconds) {
+	ros::WallTime end = ros::WallTime::now() + ros::WallDuration(seconds);
+	while(ros::WallTime::now() < end) {
+		if(!ros::ok() || _stop) return false;
+		usleep(10000);
+	}
+	return ros::ok() && !_stop;
+}
 
-int main(int argc, char** argv) {
-	ros::init(argc, argv, "iiwa_kdl");
-
-	ros::AsyncSpinner spinner(1); // Use 1 thread
-	spinner.start();
-
-	KUKA_INVDYN iiwa(0.01);
-	iiwa.run();
+//Diverter experiment: new trajectories on the HOOKED -> DETACHED and DETACHED -> IMPACT transitions.
+//True when the sequence is over, false on shutdown
+bool KUKA_INVDYN::mission_loop() {
 	ros::Rate r(50);
 	diverterState state,oldState;
-	state = iiwa.getState();
+	state = getState();
 	oldState = state;
 
-	while(ros::ok()) {
-		state = iiwa.getState();
+	while(ros::ok() && !_stop) {
+		state = getState();
 		if((state == DETACHED) && (oldState==HOOKED)) {
 			ROS_WARN("Transition from HOOKED to DETACHED.");
 			std::vector<geometry_msgs::PoseStamped> waypoints;
 			geometry_msgs::PoseStamped p;
-			iiwa.getDesPose(p);
+			getDesPose(p);
 			waypoints.push_back(p); //Initial
 			p.pose.position.x = 0.5;
 			p.pose.position.y = 0.0;
@@ -1512,18 +1651,17 @@ int main(int argc, char** argv) {
   			times.push_back(0);
   			times.push_back(12);//15
 			times.push_back(22);//30
-			iiwa.newTrajectory(waypoints,times);
+			newTrajectory(waypoints,times);
 		}
 		else if((state == IMPACT) && (oldState==DETACHED)) {
 			ROS_WARN("Transition from DETACHED to IMPACT.");
-			iiwa.setDone(false);
+			setDone(false);
 			//char c;
 			//cin>>c;
-			sleep(4);
-			if(!ros::ok()) exit(0);
+			if(!wait_for(4.0)) return false;
 			std::vector<geometry_msgs::PoseStamped> waypoints;
 			geometry_msgs::PoseStamped p;
-			iiwa.getDesPose(p);
+			getDesPose(p);
 			waypoints.push_back(p); //Initial
 			p.pose.position.z += 0.10;//0.30
 			waypoints.push_back(p); //Initial
@@ -1531,17 +1669,15 @@ int main(int argc, char** argv) {
 			times.push_back(0);
   			times.push_back(1);
 			
-			iiwa.newTrajectory(waypoints,times);
-			sleep(1);
-			exit(0);
-			//iiwa.setDone(true);
+			newTrajectory(waypoints,times);
+			wait_for(1.0);
+			return true;
+			//setDone(true);
 		}
 
 		oldState=state;
 		r.sleep();
 	}
 
-	ros::waitForShutdown();
-
-	return 0;
+	return false;
 }
@@ -0,0 +1,27 @@
+#include "../include/kuka_control/admittanceController.h"
+
+int main(int argc, char** argv) {
+	ros::init(argc, argv, "iiwa_kdl");
+
+	ros::AsyncSpinner spinner(1); // Action server and the streams with ~stream_threads false
+	spinner.start();
+
+	ros::NodeHandle nh, pnh("~");
+	double sampleTime;
+	pnh.param("sample_time", sampleTime, 0.01);
+	KUKA_INVDYN iiwa(nh, pnh, sampleTime);
+	if(!iiwa.init()) return 1;
+	iiwa.run();
+
+	if(iiwa.mission_loop()) {
+		iiwa.saveFtCalibration();
+		exit(0);
+	}
+
+	//The node exits when the controller stops itself on a failed tick budget check
+	while(ros::ok() && !iiwa.budgetFailed()) ros::WallDuration(0.1).sleep();
+	iiwa.stop();
+	iiwa.saveFtCalibration();
+
+	return iiwa.budgetFailed() ? 1 : 0;
+}
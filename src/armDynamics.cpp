@@ -0,0 +1,174 @@
+#include "../include/kuka_control/armDynamics.h"
+#include <cmath>
+
+static Eigen::Matrix3d skew(const Eigen::Vector3d& v) {
+	Eigen::Matrix3d S;
+	S <<     0, -v(2),  v(1),
+	      v(2),     0, -v(0),
+	     -v(1),  v(0),     0;
+	return S;
+}
+
+bool ARM_DYNAMICS::init(const KDL::Chain& chain, const Eigen::Vector3d& gravity) {
+	_ready = false;
+	_gravity = gravity;
+
+	//Constant part accumulated since the last joint, as in BATCH_KINEMATICS
+	KDL::Frame T = KDL::Frame::Identity();
+	int nj = 0;
+	for(unsigned int i=0; i<chain.getNrOfSegments(); i++) {
+		const KDL::Segment& seg = chain.getSegment(i);
+		const KDL::Joint& jnt = seg.getJoint();
+
+		if(jnt.getType() == KDL::Joint::None)
+			T = T*seg.pose(0.0);
+		else {
+			if(jnt.getType() != KDL::Joint::RotAxis && jnt.getType() != KDL::Joint::RotX &&
+			   jnt.getType() != KDL::Joint::RotY && jnt.getType() != KDL::Joint::RotZ)
+				return false; //only revolute chains
+			if(nj == NJ) return false;
+
+			KDL::Vector z = jnt.JointAxis();
+			z = z/z.Norm();
+			KDL::Vector x = (fabs(z.x())<0.9) ? KDL::Vector(1,0,0) : KDL::Vector(0,1,0);
+			x = x - KDL::dot(x,z)*z;
+			x = x/x.Norm();
+			KDL::Frame A( KDL::Rotation(x, z*x, z), jnt.JointOrigin() );
+
+			KDL::Frame D = T*A;
+			_DR[nj] = Eigen::Map<const Eigen::Matrix<double,3,3,Eigen::RowMajor> >(D.M.data);
+			_Dp[nj] << D.p.x(), D.p.y(), D.p.z();
+			_scale[nj] = KDL::dot(jnt.twist(1.0).rot, z);
+			_mass[nj] = 0;
+			_h[nj].setZero();
+			_I[nj].setZero();
+			T = A.Inverse()*seg.pose(0.0);
+			nj++;
+		}
+		if(nj == 0) continue; //the base does not move
+
+		//Segment inertia (KDL: tip frame, rotational part about the tip origin) into the joint frame
+		const KDL::RigidBodyInertia& I = seg.getInertia();
+		double m = I.getMass();
+		if(m <= 0) continue;
+		KDL::Vector cTip = I.getCOG();
+		Eigen::Vector3d c(cTip.x(), cTip.y(), cTip.z());
+		Eigen::Matrix3d Io = Eigen::Map<const Eigen::Matrix<double,3,3,Eigen::RowMajor> >(I.getRotationalInertia().data);
+		Eigen::Matrix3d Ic = Io + m*skew(c)*skew(c);
+		Eigen::Matrix3d R = Eigen::Map<const Eigen::Matrix<double,3,3,Eigen::RowMajor> >(T.M.data);
+		Eigen::Vector3d cj = Eigen::Vector3d(T.p.x(), T.p.y(), T.p.z()) + R*c;
+		int k = nj-1;
+		_mass[k] += m;
+		_h[k] += m*cj;
+		_I[k] += R*Ic*R.transpose() - m*skew(cj)*skew(cj);
+	}
+
+	_ready = (nj == NJ);
+	return _ready;
+}
+
+void ARM_DYNAMICS::rotations(const JointVector& q, LINK_STATE& s) const {
+	for(int i=0; i<NJ; i++) {
+		double c = cos(_scale[i]*q(i));
+		double sn = sin(_scale[i]*q(i));
+		const Eigen::Matrix3d& D = _DR[i];
+		s.R[i].col(0) = c*D.col(0) + sn*D.col(1);
+		s.R[i].col(1) = c*D.col(1) - sn*D.col(0);
+		s.R[i].col(2) = D.col(2);
+	}
+}
+
+//a0: acceleration of the base frame, -gravity to get the gravity torques
+void ARM_DYNAMICS::rnea(const LINK_STATE& s, const JointVector& qd, const JointVector& qdd, const Eigen::Vector3d& a0, JointVector& tau) const {
+	Eigen::Vector3d f[NJ], n[NJ];
+	Eigen::Vector3d w = Eigen::Vector3d::Zero(), wd = Eigen::Vector3d::Zero(), a = a0;
+
+	for(int i=0; i<NJ; i++) {
+		const Eigen::Matrix3d& R = s.R[i];
+		const Eigen::Vector3d& p = _Dp[i];
+		a = R.transpose()*(a + wd.cross(p) + w.cross(w.cross(p)));
+		Eigen::Vector3d wp = R.transpose()*w;
+		double dq = _scale[i]*qd(i);
+		w = wp;
+		w(2) += dq;
+		wd = R.transpose()*wd + Eigen::Vector3d(wp(1)*dq, -wp(0)*dq, 0);
+		wd(2) += _scale[i]*qdd(i);
+
+		f[i] = _mass[i]*a + wd.cross(_h[i]) + w.cross(w.cross(_h[i]));
+		n[i] = _I[i]*wd + w.cross(_I[i]*w) + _h[i].cross(a);
+	}
+
+	for(int i=NJ-1; i>=0; i--) {
+		if(i < NJ-1) {
+			Eigen::Vector3d fc = s.R[i+1]*f[i+1];
+			f[i] += fc;
+			n[i] += s.R[i+1]*n[i+1] + _Dp[i+1].cross(fc);
+		}
+		tau(i) = _scale[i]*n[i](2);
+	}
+}
+
+void ARM_DYNAMICS::crba(const LINK_STATE& s, JointMatrix& M) const {
+	double m[NJ];
+	Eigen::Vector3d h[NJ];
+	Eigen::Matrix3d I[NJ];
+	for(int i=0; i<NJ; i++) {
+		m[i] = _mass[i];
+		h[i] = _h[i];
+		I[i] = _I[i];
+	}
+	//Composite inertias, each about its joint origin
+	for(int i=NJ-1; i>0; i--) {
+		const Eigen::Matrix3d& R = s.R[i];
+		const Eigen::Vector3d& p = _Dp[i];
+		Eigen::Vector3d hc = R*h[i];
+		Eigen::Matrix3d Sp = skew(p), Sh = skew(hc);
+		m[i-1] += m[i];
+		h[i-1] += m[i]*p + hc;
+		I[i-1] += R*I[i]*R.transpose() - m[i]*Sp*Sp - Sp*Sh - Sh*Sp;
+	}
+
+	//Column k: wrench of composite k under unit acceleration of joint k, carried down to the base
+	for(int k=0; k<NJ; k++) {
+		Eigen::Vector3d f(-h[k](1), h[k](0), 0); //z x h
+		Eigen::Vector3d n = I[k].col(2);
+		M(k,k) = _scale[k]*_scale[k]*n(2);
+		for(int j=k-1; j>=0; j--) {
+			f = s.R[j+1]*f;
+			n = s.R[j+1]*n + _Dp[j+1].cross(f);
+			M(j,k) = M(k,j) = _scale[j]*_scale[k]*n(2);
+		}
+	}
+}
+
+void ARM_DYNAMICS::inverseDynamics(const JointVector& q, const JointVector& qd, const JointVector& qdd, JointVector& tau) const {
+	LINK_STATE s;
+	rotations(q, s);
+	rnea(s, qd, qdd, -_gravity, tau);
+}
+
+void ARM_DYNAMICS::gravity(const JointVector& q, JointVector& g) const {
+	LINK_STATE s;
+	rotations(q, s);
+	rnea(s, JointVector::Zero(), JointVector::Zero(), -_gravity, g);
+}
+
+void ARM_DYNAMICS::coriolis(const JointVector& q, const JointVector& qd, JointVector& c) const {
+	LINK_STATE s;
+	rotations(q, s);
+	rnea(s, qd, JointVector::Zero(), Eigen::Vector3d::Zero(), c);
+}
+
+void ARM_DYNAMICS::inertia(const JointVector& q, JointMatrix& M) const {
+	LINK_STATE s;
+	rotations(q, s);
+	crba(s, M);
+}
+
+void ARM_DYNAMICS::compute(const JointVector& q, const JointVector& qd, JointMatrix& M, JointVector& c, JointVector& g) const {
+	LINK_STATE s;
+	rotations(q, s);
+	crba(s, M);
+	rnea(s, qd, JointVector::Zero(), Eigen::Vector3d::Zero(), c);
+	rnea(s, JointVector::Zero(), JointVector::Zero(), -_gravity, g);
+}
@@ -0,0 +1,113 @@
+#include "../include/kuka_control/asyncLog.h"
+
+#include <cstdarg>
+#include <time.h>
+#include <unistd.h>
+
+ASYNC_LOG& ASYNC_LOG::instance() {
+	static ASYNC_LOG log;
+	return log;
+}
+
+ASYNC_LOG::ASYNC_LOG() {
+	for(uint64_t i=0; i<ASYNC_LOG_RECORDS; i++) _ring[i].seq.store(i, std::memory_order_relaxed);
+	_head.store(0, std::memory_order_relaxed);
+	_tail = 0;
+	_dropped.store(0, std::memory_order_relaxed);
+	_droppedReported = 0;
+	_stop = false;
+	_thread = boost::thread(&ASYNC_LOG::loop, this);
+}
+
+ASYNC_LOG::~ASYNC_LOG() {
+	_stop = true;
+	_thread.join();
+}
+
+int64_t ASYNC_LOG::now() {
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (int64_t)t.tv_sec*1000000000LL + t.tv_nsec;
+}
+
+//One caller per period gets through, the others are counted on the site
+bool ASYNC_LOG::admit(ASYNC_LOG_SITE& site, uint32_t& suppressed) {
+	if(site.period > 0) {
+		int64_t t = now();
+		int64_t next = site.next.load(std::memory_order_relaxed);
+		if(t < next || !site.next.compare_exchange_strong(next, t + (int64_t)(site.period*1e9), std::memory_order_relaxed)) {
+			site.suppressed.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+	}
+	suppressed = site.suppressed.exchange(0, std::memory_order_relaxed);
+	return true;
+}
+
+//Bounded multi-producer ring: a slot is free for position pos when its seq is pos, ready to be read when pos+1
+ASYNC_LOG_RECORD* ASYNC_LOG::claim(uint64_t& pos) {
+	pos = _head.load(std::memory_order_relaxed);
+	while(true) {
+		ASYNC_LOG_RECORD* r = &_ring[pos & (ASYNC_LOG_RECORDS-1)];
+		int64_t diff = (int64_t)(r->seq.load(std::memory_order_acquire) - pos);
+		if(diff == 0) {
+			if(_head.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)) return r;
+		}
+		else if(diff < 0) {
+			_dropped.fetch_add(1, std::memory_order_relaxed);
+			return 0;
+		}
+		else
+			pos = _head.load(std::memory_order_relaxed);
+	}
+}
+
+bool ASYNC_LOG::log(ASYNC_LOG_SITE& site, ros::console::levels::Level level, const char* fmt, ...) {
+	uint32_t suppressed;
+	if(!admit(site, suppressed)) return false;
+	uint64_t pos;
+	ASYNC_LOG_RECORD* r = claim(pos);
+	if(!r) return false;
+	r->level = level;
+	r->suppressed = suppressed;
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(r->text, ASYNC_LOG_TEXT, fmt, args);
+	va_end(args);
+	r->seq.store(pos+1, std::memory_order_release);
+	return true;
+}
+
+bool ASYNC_LOG::drain() {
+	bool any = false;
+	while(true) {
+		ASYNC_LOG_RECORD* r = &_ring[_tail & (ASYNC_LOG_RECORDS-1)];
+		if(r->seq.load(std::memory_order_acquire) != _tail+1) break;
+		char text[ASYNC_LOG_TEXT + 32];
+		if(r->suppressed) snprintf(text, sizeof(text), "%s (%u more suppressed)", r->text, r->suppressed);
+		else snprintf(text, sizeof(text), "%s", r->text);
+		//One rosconsole location per level: the level of a location is fixed at its first use
+		switch(r->level) {
+			case ros::console::levels::Debug: ROS_DEBUG("%s", text); break;
+			case ros::console::levels::Info: ROS_INFO("%s", text); break;
+			case ros::console::levels::Warn: ROS_WARN("%s", text); break;
+			default: ROS_ERROR("%s", text); break;
+		}
+		r->seq.store(_tail + ASYNC_LOG_RECORDS, std::memory_order_release);
+		_tail++;
+		any = true;
+	}
+	uint64_t dropped = _dropped.load(std::memory_order_relaxed);
+	if(dropped > _droppedReported) {
+		ROS_WARN("Async log: %lu records dropped on a full ring", (unsigned long)(dropped - _droppedReported));
+		_droppedReported = dropped;
+	}
+	return any;
+}
+
+//Polled: the producers never make a system call to wake the drain thread
+void ASYNC_LOG::loop() {
+	while(!_stop)
+		if(!drain()) usleep(10000);
+	drain();
+}
@@ -0,0 +1,159 @@
+#include "../include/kuka_control/batchKinematics.h"
+#include "boost/thread.hpp"
+#include <cmath>
+#include <algorithm>
+
+KDL::Frame POSE_BATCH::frame(int k) const {
+	const double* r = &R[k];
+	return KDL::Frame( KDL::Rotation(r[0],r[size],r[2*size],r[3*size],r[4*size],r[5*size],r[6*size],r[7*size],r[8*size]),
+	                   KDL::Vector(p[k],p[size+k],p[2*size+k]) );
+}
+
+void POSE_BATCH::jacobian(int k, Eigen::Matrix<double,6,Eigen::Dynamic>& Jk) const {
+	Jk.resize(6,nj);
+	for(int j=0; j<nj; j++)
+		for(int r=0; r<6; r++)
+			Jk(r,j) = J[(6*j+r)*size+k];
+}
+
+bool BATCH_KINEMATICS::init(const KDL::Chain& chain) {
+	_D.clear();
+	_scale.clear();
+	_nj = 0;
+
+	//Constant part accumulated since the last joint
+	KDL::Frame T = KDL::Frame::Identity();
+	for(unsigned int i=0; i<chain.getNrOfSegments(); i++) {
+		const KDL::Segment& seg = chain.getSegment(i);
+		const KDL::Joint& jnt = seg.getJoint();
+
+		if(jnt.getType() == KDL::Joint::None) {
+			T = T*seg.pose(0.0);
+			continue;
+		}
+		if(jnt.getType() != KDL::Joint::RotAxis && jnt.getType() != KDL::Joint::RotX &&
+		   jnt.getType() != KDL::Joint::RotY && jnt.getType() != KDL::Joint::RotZ)
+			return false; //only revolute chains
+		if(_nj == MAX_JOINTS) return false;
+
+		//A: frame with z on the joint axis and origin on it, so that joint motion is A*Rz(q)*A^-1
+		KDL::Vector z = jnt.JointAxis();
+		z = z/z.Norm();
+		KDL::Vector x = (fabs(z.x())<0.9) ? KDL::Vector(1,0,0) : KDL::Vector(0,1,0);
+		x = x - KDL::dot(x,z)*z;
+		x = x/x.Norm();
+		KDL::Frame A( KDL::Rotation(x, z*x, z), jnt.JointOrigin() );
+
+		_D.push_back(T*A);
+		_scale.push_back(KDL::dot(jnt.twist(1.0).rot, z));
+		T = A.Inverse()*seg.pose(0.0);
+		_nj++;
+	}
+	_D.push_back(T);
+
+	return _nj>0;
+}
+
+template<int L>
+void BATCH_KINEMATICS::kernel(const JOINT_BATCH& q, POSE_BATCH& out, bool jacobian, int first) const {
+	const int N = q.size;
+	double R[9][L], p[3][L];
+	double z[MAX_JOINTS][3][L], o[MAX_JOINTS][3][L];
+
+	const KDL::Frame& D0 = _D[0];
+	for(int k=0; k<L; k++) {
+		for(int i=0; i<9; i++) R[i][k] = D0.M.data[i];
+		for(int i=0; i<3; i++) p[i][k] = D0.p.data[i];
+	}
+
+	for(int j=0; j<_nj; j++) {
+		const double* qj = q.joint(j) + first;
+		const double s = _scale[j];
+
+		//R = R*Rz(q): only the first two columns change
+		for(int k=0; k<L; k++) {
+			double c = cos(s*qj[k]);
+			double sn = sin(s*qj[k]);
+			for(int r=0; r<3; r++) {
+				double c0 = R[3*r][k], c1 = R[3*r+1][k];
+				R[3*r][k] = c*c0 + sn*c1;
+				R[3*r+1][k] = -sn*c0 + c*c1;
+			}
+		}
+
+		//Joint axis and origin in the base frame
+		for(int i=0; i<3; i++)
+			for(int k=0; k<L; k++) {
+				z[j][i][k] = R[3*i+2][k];
+				o[j][i][k] = p[i][k];
+			}
+
+		//R,p = (R,p)*D[j+1]
+		const double* Dm = _D[j+1].M.data;
+		const double* Dp = _D[j+1].p.data;
+		for(int r=0; r<3; r++)
+			for(int k=0; k<L; k++) {
+				double a0 = R[3*r][k], a1 = R[3*r+1][k], a2 = R[3*r+2][k];
+				p[r][k] += a0*Dp[0] + a1*Dp[1] + a2*Dp[2];
+				R[3*r][k]   = a0*Dm[0] + a1*Dm[3] + a2*Dm[6];
+				R[3*r+1][k] = a0*Dm[1] + a1*Dm[4] + a2*Dm[7];
+				R[3*r+2][k] = a0*Dm[2] + a1*Dm[5] + a2*Dm[8];
+			}
+	}
+
+	for(int i=0; i<3; i++)
+		for(int k=0; k<L; k++)
+			out.p[i*N+first+k] = p[i][k];
+	for(int i=0; i<9; i++)
+		for(int k=0; k<L; k++)
+			out.R[i*N+first+k] = R[i][k];
+
+	if(!jacobian) return;
+
+	//Column j: [z x (p_tip - o); z]
+	for(int j=0; j<_nj; j++) {
+		double* Jj = &out.J[6*j*N + first];
+		const double s = _scale[j];
+		for(int k=0; k<L; k++) {
+			double dx = p[0][k]-o[j][0][k], dy = p[1][k]-o[j][1][k], dz = p[2][k]-o[j][2][k];
+			double zx = z[j][0][k], zy = z[j][1][k], zz = z[j][2][k];
+			Jj[k]     = s*(zy*dz - zz*dy);
+			Jj[N+k]   = s*(zz*dx - zx*dz);
+			Jj[2*N+k] = s*(zx*dy - zy*dx);
+			Jj[3*N+k] = s*zx;
+			Jj[4*N+k] = s*zy;
+			Jj[5*N+k] = s*zz;
+		}
+	}
+}
+
+void BATCH_KINEMATICS::computeRange(const JOINT_BATCH& q, POSE_BATCH& out, bool jacobian, int lanes, int first, int last) const {
+	int k = first;
+	if(lanes == 8) {
+		for(; k+8<=last; k+=8) kernel<8>(q,out,jacobian,k);
+	}
+	else {
+		for(; k+4<=last; k+=4) kernel<4>(q,out,jacobian,k);
+	}
+	for(; k<last; k++) kernel<1>(q,out,jacobian,k);
+}
+
+void BATCH_KINEMATICS::compute(const JOINT_BATCH& q, POSE_BATCH& out, bool jacobian, int lanes, int threads) const {
+	out.resize(_nj,q.size);
+
+	if(threads <= 1) {
+		computeRange(q,out,jacobian,lanes,0,q.size);
+		return;
+	}
+
+	//Chunks aligned to lane groups, so only the last one has a scalar tail
+	int chunk = (q.size + threads - 1)/threads;
+	chunk = ((chunk + lanes - 1)/lanes)*lanes;
+
+	boost::thread_group workers;
+	for(int first=0; first<q.size; first+=chunk) {
+		int last = std::min(first+chunk, q.size);
+		workers.create_thread( boost::bind(&BATCH_KINEMATICS::computeRange, this, boost::cref(q), boost::ref(out), jacobian, lanes, first, last) );
+	}
+	workers.join_all();
+}
@@ -0,0 +1,91 @@
+#include "../include/kuka_control/distanceField.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+//Usage: buildDistanceField <cell_description> <output_grid> [resolution]
+//Cell description, one entry per line ('#' comments):
+//  bounds xmin ymin zmin xmax ymax zmax   grid extent
+//  box cx cy cz sx sy sz                  forbidden axis-aligned box (center, full size)
+//  halfspace nx ny nz d                   forbidden where n.p > d
+int main(int argc, char** argv) {
+
+	if(argc<3) {
+		cout<<"Usage: buildDistanceField <cell_description> <output_grid> [resolution]"<<endl;
+		return 1;
+	}
+	double resolution = (argc>3) ? atof(argv[3]) : 0.02;
+
+	ifstream in(argv[1]);
+	if(!in) {
+		cout<<"Cannot open "<<argv[1]<<endl;
+		return 1;
+	}
+
+	double lo[3] = {-1.2,-1.2,-0.4}, hi[3] = {1.2,1.2,1.6};
+	std::vector<Eigen::VectorXd> boxes, halfspaces;
+	string line;
+	while(getline(in,line)) {
+		istringstream ss(line);
+		string type;
+		if(!(ss>>type) || type[0]=='#') continue;
+		if(type == "bounds") {
+			ss>>lo[0]>>lo[1]>>lo[2]>>hi[0]>>hi[1]>>hi[2];
+		}
+		else if(type == "box") {
+			Eigen::VectorXd b(6);
+			for(int i=0; i<6; i++) ss>>b(i);
+			boxes.push_back(b);
+		}
+		else if(type == "halfspace") {
+			Eigen::VectorXd h(4);
+			for(int i=0; i<4; i++) ss>>h(i);
+			h /= h.head(3).norm();
+			halfspaces.push_back(h);
+		}
+		else {
+			cout<<"Unknown entry: "<<line<<endl;
+			return 1;
+		}
+		if(ss.fail()) {
+			cout<<"Malformed entry: "<<line<<endl;
+			return 1;
+		}
+	}
+
+	uint32_t dims[3];
+	for(int i=0; i<3; i++)
+		dims[i] = (uint32_t)ceil((hi[i]-lo[i])/resolution)+1;
+
+	DISTANCE_FIELD sdf;
+	sdf.create(lo,resolution,dims);
+
+	for(uint32_t ix=0; ix<dims[0]; ix++)
+		for(uint32_t iy=0; iy<dims[1]; iy++)
+			for(uint32_t iz=0; iz<dims[2]; iz++) {
+				Eigen::Vector3d p = sdf.cellCenter(ix,iy,iz);
+				double d = std::numeric_limits<double>::max();
+				for(unsigned int i=0; i<boxes.size(); i++) {
+					Eigen::Vector3d q = (p-boxes[i].head(3)).cwiseAbs() - 0.5*boxes[i].tail(3);
+					double outside = q.cwiseMax(0.0).norm();
+					double inside = std::min(q.maxCoeff(),0.0);
+					d = std::min(d, outside+inside);
+				}
+				for(unsigned int i=0; i<halfspaces.size(); i++)
+					d = std::min(d, halfspaces[i](3) - halfspaces[i].head(3).dot(p));
+				sdf.at(ix,iy,iz) = (float)std::min(d,10.0); //10m: no obstacle
+			}
+
+	if(!sdf.save(argv[2])) {
+		cout<<"Failed to write "<<argv[2]<<endl;
+		return 1;
+	}
+	cout<<"Grid "<<dims[0]<<"x"<<dims[1]<<"x"<<dims[2]<<" written to "<<argv[2]<<endl;
+	return 0;
+}
@@ -0,0 +1,150 @@
+#include <kdl_parser/kdl_parser.hpp>
+#include <urdf/model.h>
+#include "boost/thread.hpp"
+
+#include "../include/kuka_control/batchKinematics.h"
+#include "../include/kuka_control/reachabilityMap.h"
+#include "../include/kuka_control/modelCache.h"
+
+#include <iostream>
+#include <cstdlib>
+#include <algorithm>
+
+using namespace std;
+
+//Usage: buildReachabilityMap <urdf> <output_map> --model <name> --tip <link> [--base <link>] [--samples n]
+//                            [--resolution m] [--bounds xmin ymin zmin xmax ymax zmax] [--bins az el roll]
+//Samples joint space within the URDF limits and keeps, for every position/orientation cell,
+//the configuration with the highest manipulability sqrt(det(J*J^T)). The model, tip and chain
+//hash go in the map header: the controller refuses a map of another arm or tool frame.
+//Without --bounds the grid is the cube of the chain reach around the base
+static void usage() {
+	cout<<"Usage: buildReachabilityMap <urdf> <output_map> --model <name> --tip <link> [--base <link>] [--samples n]"<<endl;
+	cout<<"                            [--resolution m] [--bounds xmin ymin zmin xmax ymax zmax] [--bins az el roll]"<<endl;
+}
+
+int main(int argc, char** argv) {
+
+	if(argc<3) {
+		usage();
+		return 1;
+	}
+
+	long nSamples = 20000000;
+	double resolution = 0.1;
+	std::string modelName, base_link = "iiwa_link_0", tip_link;
+	double lo[3], hi[3];
+	bool bounds = false;
+	uint32_t bins[3] = {8, 4, 8};
+	for(int i=3; i<argc; i++) {
+		std::string opt = argv[i];
+		int n = (opt == "--bounds") ? 6 : (opt == "--bins") ? 3 : 1;
+		if(i+n >= argc) {
+			usage();
+			return 1;
+		}
+		if(opt == "--model") modelName = argv[i+1];
+		else if(opt == "--tip") tip_link = argv[i+1];
+		else if(opt == "--base") base_link = argv[i+1];
+		else if(opt == "--samples") nSamples = atol(argv[i+1]);
+		else if(opt == "--resolution") resolution = atof(argv[i+1]);
+		else if(opt == "--bounds") {
+			for(int k=0; k<3; k++) {
+				lo[k] = atof(argv[i+1+k]);
+				hi[k] = atof(argv[i+4+k]);
+			}
+			bounds = true;
+		}
+		else if(opt == "--bins")
+			for(int k=0; k<3; k++) bins[k] = (uint32_t)atoi(argv[i+1+k]);
+		else {
+			usage();
+			return 1;
+		}
+		i += n;
+	}
+	if(modelName == "" || tip_link == "" || resolution <= 0 || bins[0] == 0 || bins[1] == 0 || bins[2] == 0) {
+		usage();
+		return 1;
+	}
+
+	urdf::Model model;
+	KDL::Tree tree;
+	KDL::Chain chain;
+	if(!model.initFile(argv[1]) || !kdl_parser::treeFromUrdfModel(model, tree) || !tree.getChain(base_link, tip_link, chain)) {
+		cout<<"Failed to construct kdl chain"<<endl;
+		return 1;
+	}
+
+	BATCH_KINEMATICS kin;
+	if(!kin.init(chain)) return 1;
+	int nj = chain.getNrOfJoints();
+
+	std::vector<double> lower, upper;
+	for(unsigned int i=0; i<chain.getNrOfSegments(); i++) {
+		const KDL::Joint& jnt = chain.getSegment(i).getJoint();
+		if(jnt.getType() == KDL::Joint::None) continue;
+		urdf::JointConstSharedPtr j = model.getJoint(jnt.getName());
+		if(j && j->limits && j->type != urdf::Joint::CONTINUOUS) {
+			lower.push_back(j->limits->lower);
+			upper.push_back(j->limits->upper);
+		}
+		else {
+			lower.push_back(-M_PI);
+			upper.push_back(M_PI);
+		}
+	}
+
+	//Upper bound of the reach: the segment lengths in a line
+	if(!bounds) {
+		double reach = 0;
+		for(unsigned int i=0; i<chain.getNrOfSegments(); i++)
+			reach += chain.getSegment(i).getFrameToTip().p.Norm();
+		for(int k=0; k<3; k++) {
+			lo[k] = -reach;
+			hi[k] = reach;
+		}
+	}
+	double origin[3];
+	uint32_t dims[3];
+	for(int k=0; k<3; k++) {
+		origin[k] = lo[k];
+		dims[k] = (uint32_t)std::max(1.0, ceil((hi[k]-lo[k])/resolution));
+	}
+	cout<<modelName<<" "<<base_link<<" -> "<<tip_link<<": "<<dims[0]<<"x"<<dims[1]<<"x"<<dims[2]<<" voxels from ("
+	    <<origin[0]<<", "<<origin[1]<<", "<<origin[2]<<"), "<<bins[0]<<"x"<<bins[1]<<"x"<<bins[2]<<" orientation bins"<<endl;
+
+	REACHABILITY_MAP map;
+	map.create(origin,resolution,dims,bins[0],bins[1],bins[2],nj,modelName,tip_link,ROBOT_MODEL::chainHash(chain));
+
+	const int batchSize = 1<<16;
+	JOINT_BATCH q(nj,batchSize);
+	POSE_BATCH out;
+	Eigen::Matrix<double,6,Eigen::Dynamic> J;
+	std::vector<double> qk(nj);
+	long inserted = 0;
+	srand(0);
+
+	for(long done=0; done<nSamples; done+=batchSize) {
+		for(int j=0; j<nj; j++)
+			for(int k=0; k<batchSize; k++)
+				q.joint(j)[k] = lower[j] + (upper[j]-lower[j])*rand()/RAND_MAX;
+
+		kin.compute(q,out,true,8,boost::thread::hardware_concurrency());
+
+		for(int k=0; k<batchSize; k++) {
+			out.jacobian(k,J);
+			double manip = sqrt(fabs((J*J.transpose()).determinant()));
+			for(int j=0; j<nj; j++) qk[j] = q.joint(j)[k];
+			if(map.insert(out.frame(k),&qk[0],(float)manip)) inserted++;
+		}
+		cout<<"\r"<<done+batchSize<<"/"<<nSamples<<" samples, "<<inserted<<" cell updates"<<flush;
+	}
+	cout<<endl;
+
+	if(!map.save(argv[2])) {
+		cout<<"Failed to write "<<argv[2]<<endl;
+		return 1;
+	}
+	return 0;
+}
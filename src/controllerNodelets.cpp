@@ -0,0 +1,54 @@
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+#include "../include/kuka_control/admittanceController.h"
+#include "../include/kuka_control/jointController.h"
+
+//The controllers loaded into a nodelet manager: messages from the F/T driver and to the robot interface
+//loaded in the same manager are passed as pointers. Parameters are read from the nodelet namespace
+namespace kuka_control {
+
+class ADMITTANCE_NODELET : public nodelet::Nodelet {
+	public:
+		~ADMITTANCE_NODELET() {
+			if(!_iiwa) return;
+			_iiwa->stop();
+			_missionThread.join();
+			_iiwa->saveFtCalibration();
+		};
+	private:
+		virtual void onInit() {
+			ros::NodeHandle& nh = getNodeHandle();
+			ros::NodeHandle& pnh = getPrivateNodeHandle();
+			double sampleTime;
+			bool mission;
+			pnh.param("sample_time", sampleTime, 0.01);
+			pnh.param("mission", mission, true);
+			_iiwa.reset(new KUKA_INVDYN(nh, pnh, sampleTime));
+			//A controller that cannot start leaves this nodelet idle, the manager and the other nodelets keep running
+			if(!_iiwa->init()) {
+				NODELET_ERROR("Admittance controller not started");
+				_iiwa.reset();
+				return;
+			}
+			_iiwa->run();
+			//The node ends with the mission, the manager keeps the controller running
+			if(mission) _missionThread = boost::thread(&KUKA_INVDYN::mission_loop, _iiwa.get());
+		};
+		boost::shared_ptr<KUKA_INVDYN> _iiwa;
+		boost::thread _missionThread;
+};
+
+class JOINT_CONTROL_NODELET : public nodelet::Nodelet {
+	private:
+		virtual void onInit() {
+			_kc.reset(new KUKA_CONTROL(getNodeHandle(), getPrivateNodeHandle()));
+			_kc->run();
+		};
+		boost::shared_ptr<KUKA_CONTROL> _kc;
+};
+
+}
+
+PLUGINLIB_EXPORT_CLASS(kuka_control::ADMITTANCE_NODELET, nodelet::Nodelet)
+PLUGINLIB_EXPORT_CLASS(kuka_control::JOINT_CONTROL_NODELET, nodelet::Nodelet)
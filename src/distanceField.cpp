@@ -0,0 +1,144 @@
+#include "../include/kuka_control/distanceField.h"
+
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char SDF_MAGIC[8] = {'I','I','W','A','S','D','F','\0'};
+static const uint32_t SDF_VERSION = 1;
+
+DISTANCE_FIELD::DISTANCE_FIELD() {
+	memset(&_header,0,sizeof(_header));
+	_mapped = NULL;
+	_mappedSize = 0;
+	_data = NULL;
+}
+
+DISTANCE_FIELD::~DISTANCE_FIELD() {
+	unload();
+}
+
+void DISTANCE_FIELD::unload() {
+	if(_mapped) munmap(_mapped,_mappedSize);
+	_mapped = NULL;
+	_mappedSize = 0;
+	_storage.clear();
+	_data = NULL;
+}
+
+void DISTANCE_FIELD::create(const double origin[3], double resolution, const uint32_t dims[3]) {
+	unload();
+	memcpy(_header.magic,SDF_MAGIC,sizeof(SDF_MAGIC));
+	_header.version = SDF_VERSION;
+	for(int i=0; i<3; i++) {
+		_header.origin[i] = origin[i];
+		_header.dims[i] = dims[i];
+	}
+	_header.resolution = resolution;
+	_storage.assign((size_t)dims[0]*dims[1]*dims[2],0.0f);
+	_data = &_storage[0];
+}
+
+Eigen::Vector3d DISTANCE_FIELD::cellCenter(uint32_t ix, uint32_t iy, uint32_t iz) const {
+	return Eigen::Vector3d(_header.origin[0] + ix*_header.resolution,
+	                       _header.origin[1] + iy*_header.resolution,
+	                       _header.origin[2] + iz*_header.resolution);
+}
+
+bool DISTANCE_FIELD::save(const std::string& file) const {
+	FILE* f = fopen(file.c_str(),"wb");
+	if(!f) return false;
+	bool ok = (fwrite(&_header,sizeof(_header),1,f) == 1) &&
+	          (fwrite(&_storage[0],sizeof(float),_storage.size(),f) == _storage.size());
+	fclose(f);
+	return ok;
+}
+
+bool DISTANCE_FIELD::load(const std::string& file) {
+	unload();
+
+	int fd = open(file.c_str(),O_RDONLY);
+	if(fd<0) return false;
+	struct stat st;
+	if(fstat(fd,&st)!=0 || st.st_size<(off_t)sizeof(SDF_HEADER)) {
+		close(fd);
+		return false;
+	}
+	void* data = mmap(NULL,st.st_size,PROT_READ,MAP_SHARED,fd,0);
+	close(fd);
+	if(data == MAP_FAILED) return false;
+
+	memcpy(&_header,data,sizeof(_header));
+	size_t n = (size_t)_header.dims[0]*_header.dims[1]*_header.dims[2];
+	if(memcmp(_header.magic,SDF_MAGIC,sizeof(SDF_MAGIC))!=0 || _header.version!=SDF_VERSION ||
+	   _header.dims[0]<2 || _header.dims[1]<2 || _header.dims[2]<2 ||
+	   (size_t)st.st_size != sizeof(SDF_HEADER)+n*sizeof(float)) {
+		munmap(data,st.st_size);
+		return false;
+	}
+
+	//Best effort: keep the grid resident, so that the control loop does not take page faults
+	mlock(data,st.st_size);
+
+	_mapped = data;
+	_mappedSize = st.st_size;
+	_data = (float*)((char*)data + sizeof(SDF_HEADER));
+	return true;
+}
+
+double DISTANCE_FIELD::distance(const Eigen::Vector3d& p, Eigen::Vector3d* gradient) const {
+	const uint32_t* dims = _header.dims;
+	uint32_t i0[3];
+	double t[3];
+	for(int i=0; i<3; i++) {
+		double c = (p(i)-_header.origin[i])/_header.resolution;
+		c = std::max(0.0, std::min(c, (double)(dims[i]-1)));
+		i0[i] = std::min((uint32_t)c, dims[i]-2);
+		t[i] = c - i0[i];
+	}
+
+	const uint32_t sy = dims[2], sx = dims[1]*dims[2];
+	const float* c = &_data[i0[0]*sx + i0[1]*sy + i0[2]];
+	double c000 = c[0],     c001 = c[1],       c010 = c[sy],      c011 = c[sy+1];
+	double c100 = c[sx],    c101 = c[sx+1],    c110 = c[sx+sy],   c111 = c[sx+sy+1];
+
+	double c00 = c000 + (c001-c000)*t[2], c01 = c010 + (c011-c010)*t[2];
+	double c10 = c100 + (c101-c100)*t[2], c11 = c110 + (c111-c110)*t[2];
+	double c0 = c00 + (c01-c00)*t[1], c1 = c10 + (c11-c10)*t[1];
+
+	if(gradient) {
+		double gx = c1 - c0;
+		double gy = (c01-c00)*(1-t[0]) + (c11-c10)*t[0];
+		double gz = ((c001-c000)*(1-t[1]) + (c011-c010)*t[1])*(1-t[0]) + ((c101-c100)*(1-t[1]) + (c111-c110)*t[1])*t[0];
+		*gradient = Eigen::Vector3d(gx,gy,gz)/_header.resolution;
+	}
+
+	return c0 + (c1-c0)*t[0];
+}
+
+double DISTANCE_FIELD::capsuleDistance(const Eigen::Vector3d& a, const Eigen::Vector3d& b, double radius) const {
+	//The field changes at most by the distance moved: every point of the segment is within step/2 of a sample
+	int n = std::max(1, (int)ceil((b-a).norm()/(0.25*_header.resolution)));
+	double step = (b-a).norm()/n;
+	double d = distance(a);
+	for(int i=1; i<=n; i++)
+		d = std::min(d, distance(a + (double)i/n*(b-a)));
+	return d - 0.5*step - radius;
+}
+
+double DISTANCE_FIELD::projectOut(Eigen::Vector3d& p, double clearance, Eigen::Vector3d* normal) const {
+	Eigen::Vector3d grad;
+	double d = distance(p,&grad) - clearance;
+	double n = grad.norm();
+	if(d>=0 || n<1e-9) return 0;
+
+	grad /= n;
+	p -= d*grad;
+	if(normal) *normal = grad;
+	return -d;
+}
@@ -0,0 +1,91 @@
+#include <kdl_parser/kdl_parser.hpp>
+#include <kdl/chaindynparam.hpp>
+
+#include "../include/kuka_control/armDynamics.h"
+
+#include <iostream>
+#include <cstdlib>
+#include <chrono>
+#include <algorithm>
+
+using namespace std;
+
+//Usage: dynamicsBench <urdf> [n_configurations]
+//Times inertia + Coriolis + gravity per configuration with KDL::ChainDynParam and ARM_DYNAMICS
+int main(int argc, char** argv) {
+
+	if(argc<2) {
+		cout<<"Usage: dynamicsBench <urdf> [n_configurations]"<<endl;
+		return 1;
+	}
+	int N = (argc>2) ? atoi(argv[2]) : 100000;
+
+	KDL::Tree tree;
+	KDL::Chain chain;
+	if(!kdl_parser::treeFromFile(argv[1], tree) || !tree.getChain("iiwa_link_0", "iiwa_link_sensor_kuka", chain)) {
+		cout<<"Failed to construct kdl chain"<<endl;
+		return 1;
+	}
+
+	ARM_DYNAMICS dyn;
+	if(!dyn.init(chain)) {
+		cout<<"Chain not supported by ARM_DYNAMICS"<<endl;
+		return 1;
+	}
+
+	const int nj = ARM_DYNAMICS::NJ;
+	std::vector<double> q(nj*N), qd(nj*N);
+	srand(0);
+	for(int i=0; i<nj*N; i++) {
+		q[i] = M_PI*(2.0*rand()/RAND_MAX - 1.0);
+		qd[i] = 2.0*rand()/RAND_MAX - 1.0;
+	}
+
+	typedef std::chrono::steady_clock clock;
+
+	KDL::ChainDynParam dynParam(chain, KDL::Vector(0,0,-9.81));
+	KDL::JntArray qk(nj), qdk(nj), ck(nj), gk(nj);
+	KDL::JntSpaceInertiaMatrix Mk(nj);
+	std::vector<double> ref(N*(nj*nj + 2*nj));
+	clock::time_point start = clock::now();
+	for(int k=0; k<N; k++) {
+		for(int j=0; j<nj; j++) {
+			qk(j) = q[k*nj+j];
+			qdk(j) = qd[k*nj+j];
+		}
+		dynParam.JntToMass(qk, Mk);
+		dynParam.JntToCoriolis(qk, qdk, ck);
+		dynParam.JntToGravity(qk, gk);
+		double* r = &ref[k*(nj*nj + 2*nj)];
+		for(int i=0; i<nj*nj; i++) r[i] = Mk.data(i);
+		for(int i=0; i<nj; i++) {
+			r[nj*nj+i] = ck(i);
+			r[nj*nj+nj+i] = gk(i);
+		}
+	}
+	double tKdl = std::chrono::duration<double>(clock::now()-start).count();
+	cout<<"KDL ChainDynParam: "<<tKdl/N*1e6<<" us/configuration"<<endl;
+
+	ARM_DYNAMICS::JointMatrix M;
+	ARM_DYNAMICS::JointVector c, g;
+	double errM = 0, errC = 0, errG = 0;
+	double tDyn = 0;
+	for(int k=0; k<N; k++) {
+		ARM_DYNAMICS::JointVector qv = Eigen::Map<const ARM_DYNAMICS::JointVector>(&q[k*nj]);
+		ARM_DYNAMICS::JointVector qdv = Eigen::Map<const ARM_DYNAMICS::JointVector>(&qd[k*nj]);
+		start = clock::now();
+		dyn.compute(qv, qdv, M, c, g);
+		tDyn += std::chrono::duration<double>(clock::now()-start).count();
+
+		const double* r = &ref[k*(nj*nj + 2*nj)];
+		for(int i=0; i<nj*nj; i++) errM = std::max(errM, fabs(M(i)-r[i]));
+		for(int i=0; i<nj; i++) {
+			errC = std::max(errC, fabs(c(i)-r[nj*nj+i]));
+			errG = std::max(errG, fabs(g(i)-r[nj*nj+nj+i]));
+		}
+	}
+	cout<<"ARM_DYNAMICS:      "<<tDyn/N*1e6<<" us/configuration ("<<tKdl/tDyn<<"x)"<<endl;
+	cout<<"Max error wrt KDL: inertia "<<errM<<"  Coriolis "<<errC<<"  gravity "<<errG<<endl;
+
+	return 0;
+}
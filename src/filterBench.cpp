@@ -0,0 +1,109 @@
+#include "../include/kuka_control/LowPassFilter.hpp"
+#include "../include/kuka_control/filterBank.h"
+#include "../include/kuka_control/decimator.h"
+
+#include <iostream>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+
+using namespace std;
+
+typedef std::chrono::steady_clock timer;
+
+static void report(const char* name, double seconds, int nSamples, double period) {
+	double ns = 1e9*seconds/nSamples;
+	cout<<name<<ns<<" ns/sample ("<<100.0*ns*1e-9/period<<"% of the sensor period)"<<endl;
+}
+
+//Usage: filterBench [sensor_rate_hz] [n_samples] [control_rate_hz]
+//Per-sample cost of filtering a 6-axis wrench: six LowPassFilter objects reconfigured every sample
+//(as the wrench callback used to do) against FILTER_BANK<6>, and of the POLYPHASE_DECIMATOR<6> stage
+int main(int argc, char** argv) {
+
+	double rate = (argc>1) ? atof(argv[1]) : 7000.0;
+	int N = (argc>2) ? atoi(argv[2]) : 7000000;
+	double ctrlRate = (argc>3) ? atof(argv[3]) : 100.0;
+	double dt = 1.0/rate;
+	double fc = 5.0/(2.0*M_PI);
+
+	std::vector<FILTER_BANK<6>::Vector> input(4096);
+	srand(0);
+	for(unsigned int k=0; k<input.size(); k++)
+		input[k] = FILTER_BANK<6>::Vector::Random()*10.0;
+
+	volatile double sink = 0;
+	timer::time_point start;
+
+	LowPassFilter lpf[6];
+	start = timer::now();
+	for(int k=0; k<N; k++) {
+		const FILTER_BANK<6>::Vector& x = input[k & 4095];
+		for(int i=0; i<6; i++)
+			sink = sink + lpf[i].update(x(i),dt,fc);
+	}
+	report("6 x LowPassFilter (reconfigured):  ", std::chrono::duration<double>(timer::now()-start).count(), N, dt);
+
+	start = timer::now();
+	for(int k=0; k<N; k++) {
+		const FILTER_BANK<6>::Vector& x = input[k & 4095];
+		for(int i=0; i<6; i++)
+			sink = sink + lpf[i].update(x(i));
+	}
+	report("6 x LowPassFilter (cached):        ", std::chrono::duration<double>(timer::now()-start).count(), N, dt);
+
+	FILTER_BANK<6> bank;
+	bank.firstOrder(dt,fc);
+	start = timer::now();
+	for(int k=0; k<N; k++)
+		sink = sink + bank.update(input[k & 4095])(0);
+	report("FILTER_BANK<6> first order:        ", std::chrono::duration<double>(timer::now()-start).count(), N, dt);
+
+	int orders[2] = {2,4};
+	for(int o=0; o<2; o++) {
+		bank.butterworth(orders[o],dt,fc);
+		start = timer::now();
+		for(int k=0; k<N; k++)
+			sink = sink + bank.update(input[k & 4095])(0);
+		cout<<"Butterworth order "<<orders[o]<<": ";
+		report("              ", std::chrono::duration<double>(timer::now()-start).count(), N, dt);
+	}
+
+	//Decimation to the control rate, with the controller defaults: push every sample, read every tick
+	POLYPHASE_DECIMATOR<6> decimator;
+	if(!decimator.init(rate, 0.25*ctrlRate, std::min(0.75*ctrlRate, 0.5*rate), 3.0/ctrlRate)) {
+		cout<<"Decimator design refused"<<endl;
+		return 1;
+	}
+	FILTER_BANK<6>::Vector y;
+	double nextTick = 0;
+	int ticks = 0;
+	start = timer::now();
+	for(int k=0; k<N; k++) {
+		double t = k*dt;
+		decimator.push(input[k & 4095], t);
+		if(t >= nextTick) {
+			decimator.output(nextTick, y);
+			sink = sink + y(0);
+			nextTick += 1.0/ctrlRate;
+			ticks++;
+		}
+	}
+	double tDec = std::chrono::duration<double>(timer::now()-start).count();
+	cout<<"POLYPHASE_DECIMATOR<6> (order "<<decimator.getOrder()<<", "<<1e3*decimator.getDelay()<<" ms delay): ";
+	report("", tDec, N, dt);
+	cout<<"  per control tick, pushes included: "<<1e9*tDec/ticks<<" ns"<<endl;
+
+	//Same response as LowPassFilter (which runs in float)
+	LowPassFilter ref(fc,dt);
+	bank.firstOrder(dt,fc);
+	bank.reset(FILTER_BANK<6>::Vector::Zero());
+	double err = 0;
+	for(int k=0; k<10000; k++) {
+		const FILTER_BANK<6>::Vector& x = input[k & 4095];
+		err = std::max(err, fabs(bank.update(x)(0) - ref.update(x(0))));
+	}
+	cout<<"Max deviation from LowPassFilter: "<<err<<endl;
+
+	return 0;
+}
@@ -0,0 +1,107 @@
+#include "../include/kuka_control/friShm.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <time.h>
+#include <new>
+
+FRI_SHM::FRI_SHM() {
+	_seg = 0;
+	_owner = false;
+	_cmdSeq = 0;
+	_stateSeq = 0;
+}
+
+uint64_t FRI_SHM::now() {
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec*1000000000ULL + t.tv_nsec;
+}
+
+bool FRI_SHM::create(const std::string& name) {
+	close();
+	shm_unlink(name.c_str());
+	int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0660);
+	if(fd < 0) return false;
+	if(ftruncate(fd, sizeof(FRI_SHM_SEGMENT)) != 0) {
+		::close(fd);
+		shm_unlink(name.c_str());
+		return false;
+	}
+	void* p = mmap(0, sizeof(FRI_SHM_SEGMENT), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if(p == MAP_FAILED) {
+		shm_unlink(name.c_str());
+		return false;
+	}
+	//Locked in memory so the real-time paths never fault on it
+	mlock(p, sizeof(FRI_SHM_SEGMENT));
+
+	_seg = new (p) FRI_SHM_SEGMENT;
+	_seg->version = FRI_SHM_SEGMENT::VERSION;
+	_seg->commands.init();
+	_seg->states.init();
+	_seg->magic.store(FRI_SHM_SEGMENT::MAGIC, std::memory_order_release);
+	_name = name;
+	_owner = true;
+	return true;
+}
+
+bool FRI_SHM::open(const std::string& name) {
+	close();
+	int fd = shm_open(name.c_str(), O_RDWR, 0);
+	if(fd < 0) return false;
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(FRI_SHM_SEGMENT)) {
+		::close(fd);
+		return false;
+	}
+	void* p = mmap(0, sizeof(FRI_SHM_SEGMENT), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if(p == MAP_FAILED) return false;
+	FRI_SHM_SEGMENT* seg = static_cast<FRI_SHM_SEGMENT*>(p);
+	if(seg->magic.load(std::memory_order_acquire) != FRI_SHM_SEGMENT::MAGIC || seg->version != FRI_SHM_SEGMENT::VERSION) {
+		munmap(p, sizeof(FRI_SHM_SEGMENT));
+		return false;
+	}
+	mlock(p, sizeof(FRI_SHM_SEGMENT));
+	seg->states.attach();
+	_seg = seg;
+	_name = name;
+	_owner = false;
+	return true;
+}
+
+void FRI_SHM::close() {
+	if(!_seg) return;
+	munmap(_seg, sizeof(FRI_SHM_SEGMENT));
+	if(_owner) shm_unlink(_name.c_str());
+	_seg = 0;
+	_owner = false;
+}
+
+bool FRI_SHM::sendCommand(SHM_JOINT_COMMAND& c) {
+	if(!_seg) return false;
+	c.seq = _cmdSeq++;
+	c.stamp = now();
+	_seg->commands.write(c);
+	return true;
+}
+
+bool FRI_SHM::latestState(SHM_JOINT_STATE& s, unsigned long* skipped) {
+	return _seg && _seg->states.latest(s, skipped);
+}
+
+bool FRI_SHM::latestCommand(SHM_JOINT_COMMAND& c, unsigned long* skipped) {
+	return _seg && _seg->commands.latest(c, skipped);
+}
+
+bool FRI_SHM::sendState(SHM_JOINT_STATE& s) {
+	if(!_seg) return false;
+	s.seq = _stateSeq++;
+	s.stamp = now();
+	_seg->states.write(s);
+	return true;
+}
@@ -0,0 +1,133 @@
+#include "../include/kuka_control/ftCalibration.h"
+
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+//Covariance of an unobserved parameter, and the level below which the payload is trusted. In units of the
+//measurement noise (a third of the gates): the unobserved one spans some kg of payload
+static const double P_UNKNOWN = 1e4;
+static const double P_TRUSTED = 1e-3;
+//Covariance of parameters read from file
+static const double P_LOADED = 1e-4;
+
+static Eigen::Matrix3d skew(const Eigen::Vector3d& v) {
+	Eigen::Matrix3d S;
+	S <<     0, -v(2),  v(1),
+	      v(2),     0, -v(0),
+	     -v(1),  v(0),     0;
+	return S;
+}
+
+//Largest prediction variance, in units of the measurement noise
+static double spread(const Eigen::Matrix3d& S) {
+	Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> eig;
+	eig.computeDirect(S, Eigen::EigenvaluesOnly);
+	return eig.eigenvalues().maxCoeff();
+}
+
+FT_CALIBRATION::FT_CALIBRATION() {
+	_thetaF.setZero();
+	_thetaT.setZero();
+	_PF = P_UNKNOWN*Eigen::Matrix<double,4,4>::Identity();
+	_PT = P_UNKNOWN*Eigen::Matrix<double,6,6>::Identity();
+	_lambda = 1.0;
+	_valid = false;
+	_trusted = false;
+}
+
+void FT_CALIBRATION::reset(const Vector6d& bias) {
+	_thetaF << bias.head<3>(), 0;
+	_thetaT << bias.tail<3>(), 0, 0, 0;
+	//Uninformed: the measured offsets still include the unknown payload load at the current pose
+	_PF = P_UNKNOWN*Eigen::Matrix<double,4,4>::Identity();
+	_PT = P_UNKNOWN*Eigen::Matrix<double,6,6>::Identity();
+	_valid = true;
+	_trusted = false;
+}
+
+FT_CALIBRATION::Vector6d FT_CALIBRATION::predict(const Eigen::Vector3d& g) const {
+	Vector6d w;
+	w.head<3>() = _thetaF.head<3>() + _thetaF(3)*g;
+	w.tail<3>() = _thetaT.head<3>() - skew(g)*_thetaT.tail<3>();
+	return w;
+}
+
+Eigen::Vector3d FT_CALIBRATION::com() const {
+	if(fabs(_thetaF(3)) < 1e-3) return Eigen::Vector3d::Zero();
+	return _thetaT.tail<3>()/_thetaF(3);
+}
+
+bool FT_CALIBRATION::update(const Vector6d& w, const Eigen::Vector3d& g, double forceGate, double torqueGate) {
+	if(!_valid) return false;
+
+	Vector6d e = w - predict(g);
+	Eigen::Matrix<double,3,4> AF;
+	AF << Eigen::Matrix3d::Identity(), g;
+	Eigen::Matrix<double,3,6> AT;
+	AT << Eigen::Matrix3d::Identity(), -skew(g);
+	Eigen::Matrix3d SF = AF*_PF*AF.transpose();
+	Eigen::Matrix3d ST = AT*_PT*AT.transpose();
+
+	//Gates widened by the spread of the prediction along g: a new orientation is learnt, while a residual
+	//building up at a pose already fitted is a contact. Fixed once trusted
+	if(!_trusted) {
+		forceGate *= sqrt(1.0 + spread(SF));
+		torqueGate *= sqrt(1.0 + spread(ST));
+	}
+	if(e.head<3>().norm() > forceGate || e.tail<3>().norm() > torqueGate)
+		return false;
+
+	Eigen::Matrix<double,4,3> KF = _PF*AF.transpose()*(_lambda*Eigen::Matrix3d::Identity() + SF).inverse();
+	_thetaF += KF*e.head<3>();
+	_PF -= KF*AF*_PF;
+
+	Eigen::Matrix<double,6,3> KT = _PT*AT.transpose()*(_lambda*Eigen::Matrix3d::Identity() + ST).inverse();
+	_thetaT += KT*e.tail<3>();
+	_PT -= KT*AT*_PT;
+
+	//Forgetting only while the covariance is bounded: no wind-up while the pose does not change
+	if(_PF.trace() < 4*P_UNKNOWN) _PF /= _lambda;
+	if(_PT.trace() < 6*P_UNKNOWN) _PT /= _lambda;
+
+	//Latched: the gate stays on when the covariance grows back at a constant pose
+	if(_PF(3,3) < P_TRUSTED && _PT.bottomRightCorner<3,3>().diagonal().maxCoeff() < P_TRUSTED)
+		_trusted = true;
+	return true;
+}
+
+bool FT_CALIBRATION::save(const std::string& file) const {
+	if(!_valid) return false;
+	std::ofstream out(file.c_str());
+	if(!out) return false;
+	out.precision(9);
+	out << "bias_force " << _thetaF(0) << " " << _thetaF(1) << " " << _thetaF(2) << std::endl;
+	out << "bias_torque " << _thetaT(0) << " " << _thetaT(1) << " " << _thetaT(2) << std::endl;
+	out << "mass " << _thetaF(3) << std::endl;
+	out << "mass_com " << _thetaT(3) << " " << _thetaT(4) << " " << _thetaT(5) << std::endl;
+	return (bool)out;
+}
+
+bool FT_CALIBRATION::load(const std::string& file) {
+	std::ifstream in(file.c_str());
+	if(!in) return false;
+
+	int found = 0;
+	std::string line;
+	while(std::getline(in,line)) {
+		std::istringstream ls(line);
+		std::string key;
+		ls >> key;
+		if(key == "bias_force" && (ls >> _thetaF(0) >> _thetaF(1) >> _thetaF(2))) found |= 1;
+		else if(key == "bias_torque" && (ls >> _thetaT(0) >> _thetaT(1) >> _thetaT(2))) found |= 2;
+		else if(key == "mass" && (ls >> _thetaF(3))) found |= 4;
+		else if(key == "mass_com" && (ls >> _thetaT(3) >> _thetaT(4) >> _thetaT(5))) found |= 8;
+	}
+	if(found != 15) return false;
+
+	_PF = P_LOADED*Eigen::Matrix<double,4,4>::Identity();
+	_PT = P_LOADED*Eigen::Matrix<double,6,6>::Identity();
+	_valid = true;
+	_trusted = true;
+	return true;
+}
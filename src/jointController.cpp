@@ -1,57 +1,31 @@
-#include "ros/ros.h"
-#include "boost/thread.hpp"
-#include "sensor_msgs/JointState.h"
-#include <std_msgs/Float64MultiArray.h>
-
-#include <kdl_parser/kdl_parser.hpp>
-#include <kdl/chainfksolvervel_recursive.hpp>
-#include <kdl/chainfksolverpos_recursive.hpp>
-#include <kdl/chainiksolvervel_pinv.hpp>
-#include <kdl/chainfksolverpos_recursive.hpp>
-#include <kdl/chainiksolverpos_nr.hpp>
-#include <kdl/chainjnttojacsolver.hpp>
-#include <kdl/chainjnttojacdotsolver.hpp>
-#include <kdl/chaindynparam.hpp>
-
-#include "../include/kuka_control/planner.h"
+#include "../include/kuka_control/jointController.h"
 
 using namespace std;
- 
-class KUKA_CONTROL {
-	public:
-		KUKA_CONTROL();
-		void run();
-		void joint_states_cb( sensor_msgs::JointState );
-		void ctrl_loop();
-
-	private:
-		ros::NodeHandle _nh;
-		ros::Subscriber _js_sub;
-		ros::Publisher _js_pub;
-		bool _first_js;
-		KDL::JntArray *_q_in;
-		KDL::JntArray *_dq_in;
-		bool _sync;
-
-};
-
-KUKA_CONTROL::KUKA_CONTROL() {
+
+KUKA_CONTROL::KUKA_CONTROL(ros::NodeHandle& nh, ros::NodeHandle& pnh) : _nh(nh) {
 	_js_sub = _nh.subscribe("/iiwa/joint_states", 0, &KUKA_CONTROL::joint_states_cb, this);
 	_js_pub = _nh.advertise<std_msgs::Float64MultiArray>("/iiwa/jointsCommand", 0);
 
+	ASYNC_LOG::instance(); //not started from the control thread
 	_q_in = new KDL::JntArray( 7 );
 	_dq_in = new KDL::JntArray( 7 );
 	_first_js = false;
 	_sync = false;
+	_stop = false;
+
+	pnh.param("sample_time", _sTime, 0.01);
+
+	std::vector<std::string> jointNames;
+	for(int i=1; i<=7; i++) jointNames.push_back("iiwa_joint_" + std::to_string(i));
+	pnh.param("joint_names", jointNames, jointNames);
+	_jsMap.setJointNames(jointNames);
 }
 
 
-void KUKA_CONTROL::joint_states_cb( sensor_msgs::JointState js ) {
+void KUKA_CONTROL::joint_states_cb( const sensor_msgs::JointStateConstPtr& js ) {
 
-	for(int i=0; i<7; i++ ) {
-		_q_in->data[i] = js.position[i];
-		_dq_in->data[i] = js.velocity[i];
-	}
+	//Other joints sharing the topic (gripper, other arms) are skipped
+	if(!_jsMap.gather(*js, _q_in->data.data(), _dq_in->data.data())) return;
 
 	_first_js = true;
 	_sync = true;
@@ -59,41 +33,34 @@ void KUKA_CONTROL::joint_states_cb( sensor_msgs::JointState js ) {
 
 
 void KUKA_CONTROL::ctrl_loop() {
-	ros::Rate r(100);
+	ros::Rate r(1.0/_sTime);
 	std_msgs::Float64MultiArray jcmd;
 	jcmd.data.resize(7);
 
-	cout<<"Control start"<<endl;
-	while(!_first_js)
+	ALOG_INFO(0, "Joint control: waiting for the joint states");
+	while(!_first_js && !_stop)
 		usleep(1000);
 	
 	for(int i=0; i<7; i++) jcmd.data[i]=_q_in->data[i];
 	
-	float eps = 0.00001;
-	cout<<"Got JS"<<endl;
-	while( ros::ok() ) {
-		cout<<"Publishing..."<<endl;
+	double eps = 0.001*_sTime; //1 mrad/s whatever the rate
+	ALOG_INFO(0, "Joint control: started from joint 1 at %f rad", jcmd.data[0]);
+	while( ros::ok() && !_stop ) {
 		jcmd.data[0] += eps;
-		_js_pub.publish(jcmd);
+		//Published by pointer: not serialized for a subscriber in the same nodelet manager
+		_js_pub.publish(boost::make_shared<std_msgs::Float64MultiArray>(jcmd));
 		r.sleep();
 	}
 
-	cout<<endl<<"Finito"<<endl;
+	ALOG_INFO(0, "Joint control: stopped");
 }
 
 
 void KUKA_CONTROL::run() {
-	boost::thread ctrl_loop_t ( &KUKA_CONTROL::ctrl_loop, this);
-	ros::spin();
+	_ctrlThread = boost::thread( &KUKA_CONTROL::ctrl_loop, this);
 }
 
-
-int main(int argc, char** argv) {
-
-	ros::init(argc, argv, "iiwa_control");
-
-	KUKA_CONTROL kc;
-	kc.run();
-
-	return 0;
+void KUKA_CONTROL::stop() {
+	_stop = true;
+	_ctrlThread.join();
 }
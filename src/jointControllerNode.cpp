@@ -0,0 +1,13 @@
+#include "../include/kuka_control/jointController.h"
+
+int main(int argc, char** argv) {
+
+	ros::init(argc, argv, "iiwa_control");
+
+	ros::NodeHandle nh, pnh("~");
+	KUKA_CONTROL kc(nh, pnh);
+	kc.run();
+	ros::spin();
+
+	return 0;
+}
@@ -0,0 +1,152 @@
+#include <kdl_parser/kdl_parser.hpp>
+#include <kdl/chainfksolverpos_recursive.hpp>
+#include <kdl/chainjnttojacsolver.hpp>
+#include <kdl/chainfksolvervel_recursive.hpp>
+#include <kdl/chainjnttojacdotsolver.hpp>
+#include "boost/thread.hpp"
+
+#include "../include/kuka_control/batchKinematics.h"
+#include "../include/kuka_control/generatedKinematics.h"
+
+#include <iostream>
+#include <cstdlib>
+#include <chrono>
+
+using namespace std;
+
+//Usage: kinematicsBench <urdf> [n_configurations] [base_link] [tip_link] [model]
+//Prints FK+Jacobian throughput (configurations per second) of the KDL solvers and of BATCH_KINEMATICS,
+//then FK+velocity+Jacobian+J dot of the KDL solvers and of the generated kinematics of model
+int main(int argc, char** argv) {
+
+	if(argc<2) {
+		cout<<"Usage: kinematicsBench <urdf> [n_configurations] [base_link] [tip_link] [model]"<<endl;
+		return 1;
+	}
+
+	int N = (argc>2) ? atoi(argv[2]) : 100000;
+	std::string base_link = (argc>3) ? argv[3] : "iiwa_link_0";
+	std::string tip_link = (argc>4) ? argv[4] : "iiwa_link_sensor_kuka";
+	std::string model = (argc>5) ? argv[5] : "iiwa7";
+
+	KDL::Tree tree;
+	KDL::Chain chain;
+	if(!kdl_parser::treeFromFile(argv[1], tree) || !tree.getChain(base_link, tip_link, chain)) {
+		cout<<"Failed to construct kdl chain"<<endl;
+		return 1;
+	}
+
+	BATCH_KINEMATICS batch;
+	if(!batch.init(chain)) {
+		cout<<"Chain not supported by BATCH_KINEMATICS"<<endl;
+		return 1;
+	}
+
+	int nj = chain.getNrOfJoints();
+	JOINT_BATCH q(nj,N);
+	srand(0);
+	for(int i=0; i<nj*N; i++)
+		q.q[i] = M_PI*(2.0*rand()/RAND_MAX - 1.0);
+
+	typedef std::chrono::steady_clock clock;
+
+	//Reference: one KDL call at a time
+	KDL::ChainFkSolverPos_recursive fk(chain);
+	KDL::ChainJntToJacSolver jsolver(chain);
+	KDL::JntArray qk(nj);
+	KDL::Jacobian Jk(nj);
+	std::vector<KDL::Frame> F(N);
+	std::vector<Eigen::Matrix<double,6,Eigen::Dynamic> > J(N);
+
+	clock::time_point start = clock::now();
+	for(int k=0; k<N; k++) {
+		for(int j=0; j<nj; j++) qk(j) = q.joint(j)[k];
+		fk.JntToCart(qk, F[k]);
+		jsolver.JntToJac(qk, Jk);
+		J[k] = Jk.data;
+	}
+	double tKdl = std::chrono::duration<double>(clock::now()-start).count();
+	cout<<"KDL recursive:         "<<N/tKdl<<" configurations/s"<<endl;
+
+	POSE_BATCH out;
+	int maxThreads = std::max(1u, boost::thread::hardware_concurrency());
+	int lanes[2] = {4,8};
+	for(int l=0; l<2; l++) {
+		for(int threads=1; threads<=maxThreads; threads*=2) {
+			batch.compute(q,out,true,lanes[l],threads); //warm-up
+			start = clock::now();
+			batch.compute(q,out,true,lanes[l],threads);
+			double t = std::chrono::duration<double>(clock::now()-start).count();
+			cout<<"Batch lanes: "<<lanes[l]<<" threads: "<<threads<<"  "<<N/t<<" configurations/s ("<<tKdl/t<<"x)"<<endl;
+		}
+	}
+
+	double errFk = 0, errJ = 0;
+	Eigen::Matrix<double,6,Eigen::Dynamic> Jb;
+	for(int k=0; k<N; k++) {
+		KDL::Frame Fb = out.frame(k);
+		for(int i=0; i<3; i++) errFk = std::max(errFk, fabs(Fb.p(i)-F[k].p(i)));
+		for(int i=0; i<9; i++) errFk = std::max(errFk, fabs(Fb.M.data[i]-F[k].M.data[i]));
+		out.jacobian(k,Jb);
+		errJ = std::max(errJ, (Jb-J[k]).cwiseAbs().maxCoeff());
+	}
+	cout<<"Max error wrt KDL: FK "<<errFk<<"  Jacobian "<<errJ<<endl;
+
+	//Control loop path: KDL FK with velocity, Jacobian and J dot against the generated kinematics
+	ARM_KINEMATICS kin;
+	if(!kin.select(model) || nj != 7 || base_link != kin.base || tip_link != kin.tip) {
+		cout<<"No generated kinematics for "<<model<<" "<<base_link<<" -> "<<tip_link<<endl;
+		return 0;
+	}
+	std::vector<double> qd(nj*N);
+	for(int i=0; i<nj*N; i++)
+		qd[i] = 2.0*rand()/RAND_MAX - 1.0;
+
+	KDL::ChainFkSolverVel_recursive fkVel(chain);
+	KDL::ChainJntToJacDotSolver jdotSolver(chain);
+	KDL::JntArrayVel qv(nj);
+	KDL::FrameVel Fv;
+	KDL::Jacobian Jdk(nj);
+	std::vector<Eigen::Matrix<double,6,Eigen::Dynamic> > Jdot(N);
+	start = clock::now();
+	for(int k=0; k<N; k++) {
+		for(int j=0; j<nj; j++) {
+			qv.q(j) = q.joint(j)[k];
+			qv.qdot(j) = qd[j*N+k];
+		}
+		fkVel.JntToCart(qv, Fv);
+		jsolver.JntToJac(qv.q, Jk);
+		jdotSolver.JntToJacDot(qv, Jdk);
+		Jdot[k] = Jdk.data;
+	}
+	double tKdlVel = std::chrono::duration<double>(clock::now()-start).count();
+	cout<<"KDL FK vel+J+Jdot:     "<<N/tKdlVel<<" configurations/s"<<endl;
+
+	typedef std::vector<ARM_KINEMATICS::Jacobian, Eigen::aligned_allocator<ARM_KINEMATICS::Jacobian> > JACOBIANS;
+	std::vector<Eigen::Matrix3d> Rg(N);
+	std::vector<Eigen::Vector3d> pg(N);
+	JACOBIANS Jg(N), Jdg(N);
+	double qk7[7], qd7[7];
+	start = clock::now();
+	for(int k=0; k<N; k++) {
+		for(int j=0; j<7; j++) {
+			qk7[j] = q.joint(j)[k];
+			qd7[j] = qd[j*N+k];
+		}
+		kin.compute(qk7, qd7, Rg[k], pg[k], Jg[k], Jdg[k]);
+	}
+	double tGen = std::chrono::duration<double>(clock::now()-start).count();
+	cout<<"Generated "<<model<<":       "<<N/tGen<<" configurations/s ("<<tKdlVel/tGen<<"x)"<<endl;
+
+	double errJdot = 0;
+	errFk = errJ = 0;
+	for(int k=0; k<N; k++) {
+		for(int i=0; i<3; i++) errFk = std::max(errFk, fabs(pg[k](i)-F[k].p(i)));
+		for(int i=0; i<9; i++) errFk = std::max(errFk, fabs(Rg[k](i/3,i%3)-F[k].M.data[i]));
+		errJ = std::max(errJ, (Jg[k]-J[k]).cwiseAbs().maxCoeff());
+		errJdot = std::max(errJdot, (Jdg[k]-Jdot[k]).cwiseAbs().maxCoeff());
+	}
+	cout<<"Max error wrt KDL: FK "<<errFk<<"  Jacobian "<<errJ<<"  J dot "<<errJdot<<endl;
+
+	return 0;
+}
@@ -0,0 +1,71 @@
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include "ros/ros.h"
+#include "boost/thread.hpp"
+#include <geometry_msgs/WrenchStamped.h>
+
+#include "../include/kuka_control/tickBudget.h"
+
+//Transport latency only, of a synthetic wrench stream at the F/T rate: the F/T driver, the controllers
+//and the command path are not in the measure. ~role source publishes stamped wrenches on
+//latency_probe at ~rate, ~role sink logs the receive latency percentiles every ~report seconds.
+//Loaded in one manager the messages are passed as pointers; as two standalone nodelets they go
+//through TCPROS loopback, as the sensor driver and the controller in separate processes
+namespace kuka_control {
+
+class LATENCY_PROBE : public nodelet::Nodelet {
+	public:
+		LATENCY_PROBE() : _stop(false) {};
+		~LATENCY_PROBE() {
+			_stop = true;
+			_sourceThread.join();
+		};
+	private:
+		virtual void onInit() {
+			ros::NodeHandle& nh = getNodeHandle();
+			ros::NodeHandle& pnh = getPrivateNodeHandle();
+			std::string role;
+			pnh.param<std::string>("role", role, "sink");
+			pnh.param("rate", _rate, 500.0);
+			pnh.param("report", _report, 10.0);
+			if(role == "source") {
+				_pub = nh.advertise<geometry_msgs::WrenchStamped>("latency_probe", 100);
+				_sourceThread = boost::thread(&LATENCY_PROBE::source, this);
+			}
+			else {
+				_latency.init(1e-6, 0.05);
+				_lastReport = ros::WallTime::now();
+				_sub = nh.subscribe("latency_probe", 100, &LATENCY_PROBE::sink_cb, this, ros::TransportHints().tcpNoDelay());
+			}
+		};
+		void source() {
+			ros::Rate r(_rate);
+			unsigned int seq = 0;
+			while(ros::ok() && !_stop) {
+				geometry_msgs::WrenchStampedPtr msg(new geometry_msgs::WrenchStamped);
+				msg->header.seq = seq++;
+				msg->header.stamp = ros::Time::now();
+				_pub.publish(msg);
+				r.sleep();
+			}
+		};
+		void sink_cb(const geometry_msgs::WrenchStampedConstPtr& msg) {
+			_latency.add((ros::Time::now() - msg->header.stamp).toSec());
+			if((ros::WallTime::now() - _lastReport).toSec() < _report) return;
+			NODELET_INFO("Latency over %lu samples: p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us", _latency.count(),
+				1e6*_latency.percentile(50), 1e6*_latency.percentile(99), 1e6*_latency.percentile(99.9), 1e6*_latency.max());
+			_latency.reset();
+			_lastReport = ros::WallTime::now();
+		};
+		ros::Publisher _pub;
+		ros::Subscriber _sub;
+		boost::thread _sourceThread;
+		volatile bool _stop;
+		double _rate, _report;
+		TICK_BUDGET _latency;
+		ros::WallTime _lastReport;
+};
+
+}
+
+PLUGINLIB_EXPORT_CLASS(kuka_control::LATENCY_PROBE, nodelet::Nodelet)
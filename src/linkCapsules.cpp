@@ -0,0 +1,95 @@
+#include "../include/kuka_control/linkCapsules.h"
+
+static LINK_CAPSULE capsule(const char* link, double ax, double ay, double az, double bx, double by, double bz, double r) {
+	LINK_CAPSULE c;
+	c.link = link;
+	c.a << ax, ay, az;
+	c.b << bx, by, bz;
+	c.radius = r;
+	return c;
+}
+
+std::vector<LINK_CAPSULE> iiwa7Capsules() {
+	std::vector<LINK_CAPSULE> c;
+	c.push_back(capsule("iiwa_link_0", 0,0,0.05,     0,0,0.12,          0.11));
+	c.push_back(capsule("iiwa_link_1", 0,0,0,        0,0,0.19,          0.085));
+	c.push_back(capsule("iiwa_link_2", 0,0,0,        0,0.21,0,          0.085));
+	c.push_back(capsule("iiwa_link_3", 0,0,0,        0,0,0.19,          0.08));
+	c.push_back(capsule("iiwa_link_4", 0,0,0,        0,0.21,0,          0.08));
+	c.push_back(capsule("iiwa_link_5", 0,0,0,        0,0.0607,0.19,     0.07));
+	c.push_back(capsule("iiwa_link_6", 0,0,0,        0,0.081,0.0607,    0.065));
+	c.push_back(capsule("iiwa_link_7", 0,0,0,        0,0,0.075,         0.06));
+	return c;
+}
+
+std::vector<LINK_CAPSULE> iiwa14Capsules() {
+	std::vector<LINK_CAPSULE> c;
+	c.push_back(capsule("iiwa_link_0", 0,0,0.05,     0,0,0.13,          0.12));
+	c.push_back(capsule("iiwa_link_1", 0,0,0,        0,0,0.2025,        0.095));
+	c.push_back(capsule("iiwa_link_2", 0,0,0,        0,0.2045,0,        0.095));
+	c.push_back(capsule("iiwa_link_3", 0,0,0,        0,0,0.2155,        0.09));
+	c.push_back(capsule("iiwa_link_4", 0,0,0,        0,0.1845,0,        0.09));
+	c.push_back(capsule("iiwa_link_5", 0,0,0,        0,0,0.2155,        0.08));
+	c.push_back(capsule("iiwa_link_6", 0,0,0,        0,0.081,0,         0.07));
+	c.push_back(capsule("iiwa_link_7", 0,0,0,        0,0,0.075,         0.06));
+	return c;
+}
+
+bool modelCapsules(const std::string& model, std::vector<LINK_CAPSULE>& capsules) {
+	if(model == "iiwa7") capsules = iiwa7Capsules();
+	else if(model == "iiwa14") capsules = iiwa14Capsules();
+	else return false;
+	return true;
+}
+
+bool LINK_CAPSULES::init(const KDL::Chain& chain, const std::string& base_link, const std::vector<LINK_CAPSULE>& capsules) {
+	_chain = chain;
+	_capsules.clear();
+	_frame.clear();
+
+	for(unsigned int i=0; i<capsules.size(); i++) {
+		int frame = -1;
+		if(capsules[i].link == base_link) frame = 0;
+		for(unsigned int s=0; s<chain.getNrOfSegments() && frame<0; s++)
+			if(chain.getSegment(s).getName() == capsules[i].link) frame = s+1;
+		if(frame<0) {
+			_capsules.clear();
+			_frame.clear();
+			_n = 0;
+			return false;
+		}
+		_capsules.push_back(capsules[i]);
+		_frame.push_back(frame);
+	}
+
+	_n = _capsules.size();
+	_a.resize(_n);
+	_b.resize(_n);
+	return true;
+}
+
+void LINK_CAPSULES::update(const KDL::JntArray& q) {
+	KDL::Frame T = KDL::Frame::Identity();
+	unsigned int seg = 0, jnt = 0;
+
+	for(int i=0; i<_n; i++) {
+		//Capsules are sorted along the chain in the common case, then this walks it once
+		if((int)seg > _frame[i]) {
+			T = KDL::Frame::Identity();
+			seg = 0;
+			jnt = 0;
+		}
+		for(; (int)seg<_frame[i]; seg++) {
+			const KDL::Segment& s = _chain.getSegment(seg);
+			if(s.getJoint().getType() != KDL::Joint::None)
+				T = T*s.pose(q(jnt++));
+			else
+				T = T*s.pose(0.0);
+		}
+
+		KDL::Vector a = T*KDL::Vector(_capsules[i].a(0),_capsules[i].a(1),_capsules[i].a(2));
+		KDL::Vector b = T*KDL::Vector(_capsules[i].b(0),_capsules[i].b(1),_capsules[i].b(2));
+		_a[i] << a.x(), a.y(), a.z();
+		_b[i] << b.x(), b.y(), b.z();
+	}
+}
@@ -0,0 +1,197 @@
+#include "../include/kuka_control/modelCache.h"
+
+#include <kdl_parser/kdl_parser.hpp>
+#include <urdf/model.h>
+
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char MODEL_CACHE_MAGIC[8] = {'I','I','W','A','M','D','L','\0'};
+static const uint32_t MODEL_CACHE_VERSION = 1;
+
+uint64_t ROBOT_MODEL::hash(const std::string& data) {
+	uint64_t h = 14695981039346656037ULL;
+	for(unsigned int i=0; i<data.size(); i++) {
+		h ^= (unsigned char)data[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+uint64_t ROBOT_MODEL::chainHash(const KDL::Chain& chain) {
+	std::string data;
+	char buf[32];
+	for(unsigned int i=0; i<chain.getNrOfSegments(); i++) {
+		const KDL::Segment& s = chain.getSegment(i);
+		KDL::Frame F = s.getFrameToTip();
+		double v[18];
+		for(int k=0; k<3; k++) {
+			v[k] = s.getJoint().JointAxis()(k);
+			v[3+k] = s.getJoint().JointOrigin()(k);
+			v[6+k] = F.p(k);
+		}
+		for(int k=0; k<9; k++) v[9+k] = F.M.data[k];
+		snprintf(buf, sizeof(buf), "%d", (int)s.getJoint().getType());
+		data += buf;
+		//Rounded to integers so that -0 and last digit noise do not change the hash
+		for(int k=0; k<18; k++) {
+			snprintf(buf, sizeof(buf), " %lld", (long long)llround(v[k]*1e6));
+			data += buf;
+		}
+		data += '\n';
+	}
+	return hash(data);
+}
+
+bool ROBOT_MODEL::init(const std::string& urdf, const std::string& base, const std::string& tip, const std::string& cacheDir) {
+	uint64_t h = hash(urdf + '\0' + base + '\0' + tip);
+	char name[64];
+	snprintf(name, sizeof(name), "/kuka_control_%016llx.model", (unsigned long long)h);
+	_cacheFile = cacheDir + name;
+
+	_fromCache = load(_cacheFile, h);
+	if(!_fromCache) {
+		if(!parse(urdf, base, tip)) return false;
+		save(_cacheFile, h); //best effort: a read-only cache dir only costs the next start
+	}
+
+	//Chain and limits from the records
+	_chain = KDL::Chain();
+	_jointNames.clear();
+	_lower.clear();
+	_upper.clear();
+	_velocity.clear();
+	_effort.clear();
+	for(unsigned int i=0; i<_segments.size(); i++) {
+		const MODEL_CACHE_SEGMENT& s = _segments[i];
+		KDL::Joint jnt = s.revolute ?
+			KDL::Joint(s.joint, KDL::Vector(s.origin[0],s.origin[1],s.origin[2]), KDL::Vector(s.axis[0],s.axis[1],s.axis[2]), KDL::Joint::RotAxis) :
+			KDL::Joint(s.joint, KDL::Joint::None);
+		KDL::Frame tipFrame( KDL::Rotation(s.tip[0],s.tip[1],s.tip[2],s.tip[3],s.tip[4],s.tip[5],s.tip[6],s.tip[7],s.tip[8]),
+		                     KDL::Vector(s.tip[9],s.tip[10],s.tip[11]) );
+		KDL::RigidBodyInertia I( s.mass, KDL::Vector(s.cog[0],s.cog[1],s.cog[2]),
+		                         KDL::RotationalInertia(s.inertia[0],s.inertia[1],s.inertia[2],s.inertia[3],s.inertia[4],s.inertia[5]) );
+		_chain.addSegment(KDL::Segment(s.name, jnt, tipFrame, I));
+
+		if(s.revolute) {
+			_jointNames.push_back(s.joint);
+			_lower.push_back(s.lower);
+			_upper.push_back(s.upper);
+			_velocity.push_back(s.velocity);
+			_effort.push_back(s.effort);
+		}
+	}
+	return true;
+}
+
+bool ROBOT_MODEL::parse(const std::string& urdf, const std::string& base, const std::string& tip) {
+	urdf::Model model;
+	KDL::Tree tree;
+	KDL::Chain chain;
+	if(!model.initString(urdf) || !kdl_parser::treeFromUrdfModel(model, tree) || !tree.getChain(base, tip, chain))
+		return false;
+
+	_segments.clear();
+	for(unsigned int i=0; i<chain.getNrOfSegments(); i++) {
+		const KDL::Segment& seg = chain.getSegment(i);
+		const KDL::Joint& jnt = seg.getJoint();
+		if(jnt.getType() != KDL::Joint::None && jnt.getType() != KDL::Joint::RotAxis)
+			return false; //kdl_parser only builds RotAxis joints for revolute URDF joints
+
+		MODEL_CACHE_SEGMENT s;
+		memset(&s, 0, sizeof(s));
+		strncpy(s.name, seg.getName().c_str(), sizeof(s.name)-1);
+		strncpy(s.joint, jnt.getName().c_str(), sizeof(s.joint)-1);
+		s.revolute = (jnt.getType() == KDL::Joint::RotAxis);
+		KDL::Vector o = jnt.JointOrigin(), a = jnt.JointAxis();
+		for(int k=0; k<3; k++) {
+			s.origin[k] = o(k);
+			s.axis[k] = a(k);
+		}
+		KDL::Frame T = seg.getFrameToTip();
+		for(int k=0; k<9; k++) s.tip[k] = T.M.data[k];
+		for(int k=0; k<3; k++) s.tip[9+k] = T.p(k);
+
+		//KDL keeps the rotational inertia about the segment origin: back to the COG
+		const KDL::RigidBodyInertia& I = seg.getInertia();
+		KDL::Vector c = I.getCOG();
+		const double* Io = I.getRotationalInertia().data;
+		s.mass = I.getMass();
+		double cc = KDL::dot(c,c);
+		for(int k=0; k<3; k++) s.cog[k] = c(k);
+		s.inertia[0] = Io[0] - s.mass*(cc - c(0)*c(0));
+		s.inertia[1] = Io[4] - s.mass*(cc - c(1)*c(1));
+		s.inertia[2] = Io[8] - s.mass*(cc - c(2)*c(2));
+		s.inertia[3] = Io[1] + s.mass*c(0)*c(1);
+		s.inertia[4] = Io[2] + s.mass*c(0)*c(2);
+		s.inertia[5] = Io[5] + s.mass*c(1)*c(2);
+
+		s.lower = -M_PI;
+		s.upper = M_PI;
+		urdf::JointConstSharedPtr uj = model.getJoint(jnt.getName());
+		if(uj && uj->limits) {
+			if(uj->type != urdf::Joint::CONTINUOUS) {
+				s.lower = uj->limits->lower;
+				s.upper = uj->limits->upper;
+			}
+			s.velocity = uj->limits->velocity;
+			s.effort = uj->limits->effort;
+		}
+		_segments.push_back(s);
+	}
+	return true;
+}
+
+bool ROBOT_MODEL::save(const std::string& file, uint64_t hash) const {
+	MODEL_CACHE_HEADER header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MODEL_CACHE_MAGIC, sizeof(MODEL_CACHE_MAGIC));
+	header.version = MODEL_CACHE_VERSION;
+	header.nSegments = _segments.size();
+	header.hash = hash;
+
+	//Written aside and renamed, so that a concurrent start never maps a partial file
+	std::string tmp = file + ".tmp";
+	FILE* f = fopen(tmp.c_str(),"wb");
+	if(!f) return false;
+	bool ok = (fwrite(&header,sizeof(header),1,f) == 1) &&
+	          (_segments.empty() || fwrite(&_segments[0],sizeof(MODEL_CACHE_SEGMENT),_segments.size(),f) == _segments.size());
+	ok = (fclose(f) == 0) && ok;
+	if(!ok || rename(tmp.c_str(), file.c_str()) != 0) {
+		unlink(tmp.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool ROBOT_MODEL::load(const std::string& file, uint64_t hash) {
+	int fd = open(file.c_str(),O_RDONLY);
+	if(fd<0) return false;
+	struct stat st;
+	if(fstat(fd,&st)!=0 || st.st_size<(off_t)sizeof(MODEL_CACHE_HEADER)) {
+		close(fd);
+		return false;
+	}
+	void* data = mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+	close(fd);
+	if(data == MAP_FAILED) return false;
+
+	const MODEL_CACHE_HEADER* header = (const MODEL_CACHE_HEADER*)data;
+	bool ok = memcmp(header->magic,MODEL_CACHE_MAGIC,sizeof(MODEL_CACHE_MAGIC))==0 && header->version==MODEL_CACHE_VERSION &&
+	          header->hash==hash && (size_t)st.st_size==sizeof(MODEL_CACHE_HEADER)+header->nSegments*sizeof(MODEL_CACHE_SEGMENT);
+	if(ok) {
+		const MODEL_CACHE_SEGMENT* seg = (const MODEL_CACHE_SEGMENT*)((const char*)data + sizeof(MODEL_CACHE_HEADER));
+		_segments.assign(seg, seg + header->nSegments);
+		for(unsigned int i=0; i<_segments.size(); i++) {
+			_segments[i].name[sizeof(_segments[i].name)-1] = '\0';
+			_segments[i].joint[sizeof(_segments[i].joint)-1] = '\0';
+		}
+	}
+	munmap(data,st.st_size);
+	return ok;
+}
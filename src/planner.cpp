@@ -1,4 +1,5 @@
 #include "../include/kuka_control/planner.h"
+#include "../include/kuka_control/msgViews.h"
 
 //UTILS
 
@@ -36,34 +37,16 @@ Vector3d Vee(Matrix3d S) {
   return v;
 }
 
-void twist2Vector(const geometry_msgs::TwistStamped twist, VectorXd& vel) {
-  vel.resize(6);
-  vel(0) = twist.twist.linear.x;
-	vel(1) = twist.twist.linear.y;
-	vel(2) = twist.twist.linear.z;
-	vel(3) = twist.twist.angular.x;
-	vel(4) = twist.twist.angular.y;
-	vel(5) = twist.twist.angular.z;
+void twist2Vector(const geometry_msgs::TwistStamped& twist, VectorXd& vel) {
+  vel = vectorView(twist.twist);
 }
 
-void accel2Vector(const geometry_msgs::AccelStamped acc, VectorXd& a) {
-  a.resize(6);
-  a(0) = acc.accel.linear.x;
-	a(1) = acc.accel.linear.y;
-	a(2) = acc.accel.linear.z;
-	a(3) = acc.accel.angular.x;
-	a(4) = acc.accel.angular.y;
-	a(5) = acc.accel.angular.z;
+void accel2Vector(const geometry_msgs::AccelStamped& acc, VectorXd& a) {
+  a = vectorView(acc.accel);
 }
 
-void wrench2Vector(const geometry_msgs::WrenchStamped wrench, VectorXd& w) {
-  w.resize(6);
-  w(0) = wrench.wrench.force.x;
-	w(1) = wrench.wrench.force.y;
-	w(2) = wrench.wrench.force.z;
-	w(3) = wrench.wrench.torque.x;
-	w(4) = wrench.wrench.torque.y;
-	w(5) = wrench.wrench.torque.z;
+void wrench2Vector(const geometry_msgs::WrenchStamped& wrench, VectorXd& w) {
+  w = vectorView(wrench.wrench);
 }
 
 //END UTILS
@@ -275,33 +258,17 @@ void CARTESIAN_PLANNER::compute() {
 
   for (int i=0; i<(_N-1); i++) {
     //cout<<"Iter: "<<i<<endl;
-    tf::Quaternion qi(_poses[i].pose.orientation.x,_poses[i].pose.orientation.y,_poses[i].pose.orientation.z,_poses[i].pose.orientation.w);
-    tf::Quaternion qf(_poses[i+1].pose.orientation.x,_poses[i+1].pose.orientation.y,_poses[i+1].pose.orientation.z,_poses[i+1].pose.orientation.w);
-    tf::Matrix3x3 Ri_tf, Rf_tf;
-    Matrix3d Ri,Rf;
-    Ri_tf.setRotation(qi);
-    Rf_tf.setRotation(qf);
-    tf::matrixTFToEigen(Ri_tf,Ri);
-    tf::matrixTFToEigen(Rf_tf,Rf);
-
-    Matrix3d Rif = Ri.transpose()*Rf;
-
+    Quaterniond qi(_poses[i].pose.orientation.w,_poses[i].pose.orientation.x,_poses[i].pose.orientation.y,_poses[i].pose.orientation.z);
+    Quaterniond qf(_poses[i+1].pose.orientation.w,_poses[i+1].pose.orientation.x,_poses[i+1].pose.orientation.y,_poses[i+1].pose.orientation.z);
+    qi.normalize();
+    qf.normalize();
+
+    //Shortest rotation from qi to qf, in the frame of qi
+    Quaterniond qif = qi.conjugate()*qf;
+    if (qif.w() < 0) qif.coeffs() = -qif.coeffs();
     double xi = 0;
-    double xf = acos( 0.5*(Rif(0,0)+Rif(1,1)+Rif(2,2)-1) );
-    if (abs(0.5*(Rif(0,0)+Rif(1,1)+Rif(2,2)-1)) >= 1.0) xf=0;
-    Vector3d ri;
-    if (xf!=0 && xf!=M_PI) {
-      ri << Rif(2,1)-Rif(1,2) , Rif(0,2)-Rif(2,0) , Rif(1,0)-Rif(0,1) ;
-      ri = ri/(2*sin(xf));
-    }
-    else if (xf == 0) ri << 0,0,0;
-    else if (xf == M_PI) {
-      ri << Rif(0,0)+1 , Rif(1,1)+1 , Rif(2,2)+1 ;
-      ri = ri/2;
-      ri(0) = sqrt(ri(0));
-      ri(1) = sqrt(ri(1));
-      ri(2) = sqrt(ri(2));
-    }
+    double xf = 2*atan2(qif.vec().norm(), qif.w());
+    Vector3d ri = (xf > 0) ? Vector3d(qif.vec().normalized()) : Vector3d::Zero();
 
     std::vector<double> apoints;
     apoints.push_back(xi);
@@ -319,22 +286,12 @@ void CARTESIAN_PLANNER::compute() {
       //  cout<<theta<<endl;
       double thetad = aplanner._xd[j];
       double thetadd = aplanner._xdd[j];
-      Matrix3d R_i;
-      R_axisAngle(theta,ri, R_i);
-      //cout<<R_i.determinant()<<endl;
       Vector3d wi = thetad*ri;
       Vector3d wid = thetadd*ri;
 
-      Matrix3d Rb_des = Ri*R_i;
-      Vector3d wb_des = Ri*wi;
-      Vector3d wbd_des = Ri*wid;
-
-      tf::Matrix3x3 Rb_des_tf;
-      tf::matrixEigenToTF(Rb_des, Rb_des_tf);
-
-      tf::Quaternion quat;
-      Rb_des_tf.getRotation(quat);
-      quat.normalize();
+      Quaterniond quat = (qi*Quaterniond(AngleAxisd(theta,ri))).normalized();
+      Vector3d wb_des = qi*wi;
+      Vector3d wbd_des = qi*wid;
 
       geometry_msgs::PoseStamped pose;
       geometry_msgs::TwistStamped twist;
@@ -345,10 +302,10 @@ void CARTESIAN_PLANNER::compute() {
         wb_des << 0,0,0;
         wbd_des << 0,0,0;
       }
-      pose.pose.orientation.x = quat[0];
-      pose.pose.orientation.y = quat[1];
-      pose.pose.orientation.z = quat[2];
-      pose.pose.orientation.w = quat[3];
+      pose.pose.orientation.x = quat.x();
+      pose.pose.orientation.y = quat.y();
+      pose.pose.orientation.z = quat.z();
+      pose.pose.orientation.w = quat.w();
       _x.push_back(pose);
 
       twist.twist.angular.x = wb_des(0);
@@ -421,11 +378,3 @@ bool CARTESIAN_PLANNER::getNext(geometry_msgs::PoseStamped &x, geometry_msgs::Tw
   _counter++;
 }
 
-void CARTESIAN_PLANNER::R_axisAngle(double th, Vector3d r, Matrix3d &R){
-  double cc = 1-cos(th);
-
-  R << r(0)*r(0)*cc+cos(th)       , r(0)*r(1)*cc-r(2)*sin(th) , r(0)*r(2)*cc+r(1)*sin(th),
-       r(0)*r(1)*cc+r(2)*sin(th)  , r(1)*r(1)*cc+cos(th)      , r(1)*r(2)*cc-r(0)*sin(th),
-       r(0)*r(2)*cc-r(1)*sin(th)  , r(1)*r(2)*cc+r(0)*sin(th) , r(2)*r(2)*cc+cos(th);
-
-}
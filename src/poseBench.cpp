@@ -0,0 +1,136 @@
+#include <tf/tf.h>
+#include <tf_conversions/tf_eigen.h>
+
+#include "../include/kuka_control/pose.h"
+
+#include <iostream>
+#include <cstdlib>
+#include <chrono>
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+//Per-tick rotation work of the control loop as it was done through tf::Matrix3x3
+
+static void compliantFrameTf(const geometry_msgs::Pose& p_des, const Eigen::Vector3d& z, geometry_msgs::Pose& compl_) {
+	tf::Quaternion qe(p_des.orientation.x,p_des.orientation.y,p_des.orientation.z,p_des.orientation.w);
+	tf::Quaternion qd = qe;
+	tf::Matrix3x3 Re_tf, Rd_tf;
+	Eigen::Matrix3d Re,Rd;
+	Re_tf.setRotation(qe);
+	tf::matrixTFToEigen(Re_tf,Re);
+	Eigen::Vector3d eps = Re.transpose()*z;
+	double eta = sqrt(1-eps(0)*eps(0)-eps(1)*eps(1)-eps(2)*eps(2));
+	if(eta>1) eta=1;
+	else if (eta<-1) eta=-1;
+	double theta = 2*acos(eta);
+	if(theta!=0) {
+		Eigen::Vector3d axis = (1.0/sin(theta*0.5))*eps;
+		tf::Vector3 axis_tf;
+		tf::vectorEigenToTF(axis,axis_tf);
+		tf::Quaternion qerr(axis_tf,theta);
+		tf::Matrix3x3 Rerr_tf(qerr);
+		Eigen::Matrix3d Rerr;
+		tf::matrixTFToEigen(Rerr_tf,Rerr);
+		Rd = Re*Rerr;
+		tf::matrixEigenToTF(Rd,Rd_tf);
+		Rd_tf.getRotation(qd);
+	}
+	compl_.position.x = p_des.position.x + z(0);
+	compl_.orientation.x = qd.x();
+	compl_.orientation.y = qd.y();
+	compl_.orientation.z = qd.z();
+	compl_.orientation.w = qd.w();
+}
+
+static void commandFrameTf(const geometry_msgs::Pose& compl_, KDL::Frame& F) {
+	tf::Quaternion qdes(compl_.orientation.x,compl_.orientation.y,compl_.orientation.z,compl_.orientation.w);
+	tf::Matrix3x3 R(qdes);
+	for(int i=0; i<3; i++)
+		for(int j=0; j<3; j++)
+			F.M.data[3*i+j] = R[i][j];
+	F.p = KDL::Vector(compl_.position.x, compl_.position.y, compl_.position.z);
+}
+
+static Eigen::Vector3d orientationErrorTf(const geometry_msgs::Pose& pe, const geometry_msgs::Pose& pd) {
+	tf::Quaternion qe(pe.orientation.x,pe.orientation.y,pe.orientation.z,pe.orientation.w);
+	tf::Quaternion qd(pd.orientation.x,pd.orientation.y,pd.orientation.z,pd.orientation.w);
+	tf::Matrix3x3 Re_tf, Rd_tf;
+	Eigen::Matrix3d Re,Rd;
+	Re_tf.setRotation(qe);
+	Rd_tf.setRotation(qd);
+	tf::matrixTFToEigen(Re_tf,Re);
+	tf::matrixTFToEigen(Rd_tf,Rd);
+	Eigen::Matrix3d Rerr = Re.transpose()*Rd;
+	tf::Matrix3x3 Rerr_tf;
+	tf::matrixEigenToTF(Rerr,Rerr_tf);
+	tf::Quaternion qerr;
+	Rerr_tf.getRotation(qerr);
+	double angle = qerr.getAngle();
+	tf::Vector3 axis = qerr.getAxis();
+	Eigen::Vector3d eps;
+	tf::vectorTFToEigen(axis,eps);
+	return Re*(sin(angle/2.0)*eps);
+}
+
+static double rotationDistance(const KDL::Frame& A, const KDL::Frame& B) {
+	double d = 0;
+	for(int i=0; i<9; i++) d = std::max(d, fabs(A.M.data[i]-B.M.data[i]));
+	return d;
+}
+
+//Usage: poseBench [n_ticks]
+//Compliant orientation, command frame and orientation error per tick: tf round trips against POSE
+int main(int argc, char** argv) {
+
+	int N = (argc>1) ? atoi(argv[1]) : 100000;
+
+	std::vector<geometry_msgs::Pose> des(N), meas(N);
+	std::vector<POSE> desE(N), measE(N);
+	std::vector<Eigen::Vector3d> z(N);
+	srand(0);
+	for(int k=0; k<N; k++) {
+		Eigen::Quaterniond q = Eigen::Quaterniond(Eigen::Vector4d::Random()).normalized();
+		Eigen::Quaterniond dq(Eigen::AngleAxisd(0.5*rand()/RAND_MAX, Eigen::Vector3d::Random().normalized()));
+		desE[k] = POSE(q, Eigen::Vector3d::Random());
+		measE[k] = POSE((q*dq).normalized(), desE[k].p);
+		pose2Msg(desE[k], des[k]);
+		pose2Msg(measE[k], meas[k]);
+		z[k] = 0.3*Eigen::Vector3d::Random(); //rotational admittance state, |sin(angle/2)| < 0.52
+	}
+
+	typedef std::chrono::steady_clock clock;
+
+	std::vector<KDL::Frame> Ftf(N), Fq(N);
+	std::vector<Eigen::Vector3d> etf(N), eq(N);
+	geometry_msgs::Pose compl_;
+	clock::time_point start = clock::now();
+	for(int k=0; k<N; k++) {
+		compliantFrameTf(des[k], z[k], compl_);
+		commandFrameTf(compl_, Ftf[k]);
+		etf[k] = orientationErrorTf(meas[k], des[k]);
+	}
+	double tTf = std::chrono::duration<double>(clock::now()-start).count();
+
+	POSE complE;
+	start = clock::now();
+	for(int k=0; k<N; k++) {
+		complE.p = desE[k].p;
+		complE.q = compliantOrientation(desE[k].q, z[k]);
+		pose2Frame(complE, Fq[k]);
+		eq[k] = orientationError(measE[k].q, desE[k].q);
+	}
+	double tQ = std::chrono::duration<double>(clock::now()-start).count();
+
+	double errR = 0, errE = 0;
+	for(int k=0; k<N; k++) {
+		errR = std::max(errR, rotationDistance(Ftf[k], Fq[k]));
+		errE = std::max(errE, (etf[k]-eq[k]).norm());
+	}
+	cout<<"tf::Matrix3x3 round trips: "<<tTf/N*1e9<<" ns/tick"<<endl;
+	cout<<"POSE quaternions:          "<<tQ/N*1e9<<" ns/tick ("<<tTf/tQ<<"x)"<<endl;
+	cout<<"Max difference: command rotation "<<errR<<"  orientation error "<<errE<<endl;
+
+	return 0;
+}
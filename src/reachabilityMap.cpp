@@ -0,0 +1,156 @@
+#include "../include/kuka_control/reachabilityMap.h"
+
+#include <cmath>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char REACH_MAP_MAGIC[8] = {'I','I','W','A','R','C','H','\0'};
+static const uint32_t REACH_MAP_VERSION = 2;
+
+REACHABILITY_MAP::REACHABILITY_MAP() {
+	memset(&_header,0,sizeof(_header));
+	_stride = 0;
+	_nCells = 0;
+	_mapped = NULL;
+	_mappedSize = 0;
+	_cells = NULL;
+}
+
+REACHABILITY_MAP::~REACHABILITY_MAP() {
+	unload();
+}
+
+void REACHABILITY_MAP::unload() {
+	if(_mapped) munmap(_mapped,_mappedSize);
+	_mapped = NULL;
+	_mappedSize = 0;
+	_storage.clear();
+	_cells = NULL;
+}
+
+void REACHABILITY_MAP::create(const double origin[3], double resolution, const uint32_t dims[3], uint32_t azBins, uint32_t elBins, uint32_t rollBins,
+                              uint32_t nj, const std::string& model, const std::string& tip, uint64_t chainHash) {
+	unload();
+	memset(&_header,0,sizeof(_header));
+	memcpy(_header.magic,REACH_MAP_MAGIC,sizeof(REACH_MAP_MAGIC));
+	_header.version = REACH_MAP_VERSION;
+	_header.nj = nj;
+	strncpy(_header.model,model.c_str(),sizeof(_header.model)-1);
+	strncpy(_header.tip,tip.c_str(),sizeof(_header.tip)-1);
+	_header.chainHash = chainHash;
+	for(int i=0; i<3; i++) {
+		_header.origin[i] = origin[i];
+		_header.dims[i] = dims[i];
+	}
+	_header.resolution = resolution;
+	_header.azBins = azBins;
+	_header.elBins = elBins;
+	_header.rollBins = rollBins;
+
+	_stride = 1+nj;
+	_nCells = (long)dims[0]*dims[1]*dims[2]*azBins*elBins*rollBins;
+	_storage.assign(_nCells*_stride,0.0f);
+	_cells = &_storage[0];
+}
+
+long REACHABILITY_MAP::cellIndex(const KDL::Frame& F) const {
+	long idx = 0;
+	for(int i=0; i<3; i++) {
+		double c = floor((F.p(i)-_header.origin[i])/_header.resolution);
+		if(c<0 || c>=_header.dims[i]) return -1;
+		idx = idx*_header.dims[i] + (long)c;
+	}
+
+	//Tool z axis direction
+	KDL::Vector a = F.M.UnitZ();
+	double az = atan2(a.y(),a.x()) + M_PI;
+	double el = asin(std::max(-1.0,std::min(1.0,a.z()))) + M_PI/2.0;
+	uint32_t ia = std::min(_header.azBins-1, (uint32_t)(az/(2.0*M_PI)*_header.azBins));
+	uint32_t ie = std::min(_header.elBins-1, (uint32_t)(el/M_PI*_header.elBins));
+
+	//Roll about the tool z axis: the x axis brought back by the shortest rotation from the base z axis
+	//to a (swing-twist split), its angle in the base xy plane
+	KDL::Vector x = F.M.UnitX(), xs;
+	double c = a.z();
+	if(c > -1.0+1e-9) {
+		KDL::Vector k(-a.y(), a.x(), 0.0); //z x a
+		KDL::Vector kx = k*x;
+		xs = x - kx + (k*kx)/(1.0+c);
+	}
+	else
+		xs = KDL::Vector(x.x(), -x.y(), -x.z()); //a along -z: half turn about the base x axis
+	double roll = atan2(xs.y(),xs.x()) + M_PI;
+	uint32_t ir = std::min(_header.rollBins-1, (uint32_t)(roll/(2.0*M_PI)*_header.rollBins));
+
+	return ((idx*_header.azBins + ia)*_header.elBins + ie)*_header.rollBins + ir;
+}
+
+bool REACHABILITY_MAP::insert(const KDL::Frame& F, const double* q, float manipulability) {
+	long idx = cellIndex(F);
+	if(idx<0) return false;
+
+	float* cell = &_storage[idx*_stride];
+	if(manipulability <= cell[0]) return false;
+	cell[0] = manipulability;
+	for(uint32_t j=0; j<_header.nj; j++)
+		cell[1+j] = q[j];
+	return true;
+}
+
+bool REACHABILITY_MAP::save(const std::string& file) const {
+	FILE* f = fopen(file.c_str(),"wb");
+	if(!f) return false;
+	bool ok = (fwrite(&_header,sizeof(_header),1,f) == 1) &&
+	          (fwrite(&_storage[0],sizeof(float),_storage.size(),f) == _storage.size());
+	fclose(f);
+	return ok;
+}
+
+bool REACHABILITY_MAP::load(const std::string& file) {
+	unload();
+
+	int fd = open(file.c_str(),O_RDONLY);
+	if(fd<0) return false;
+	struct stat st;
+	if(fstat(fd,&st)!=0 || st.st_size<(off_t)sizeof(REACH_MAP_HEADER)) {
+		close(fd);
+		return false;
+	}
+	void* data = mmap(NULL,st.st_size,PROT_READ,MAP_SHARED,fd,0);
+	close(fd);
+	if(data == MAP_FAILED) return false;
+
+	memcpy(&_header,data,sizeof(_header));
+	_stride = 1+_header.nj;
+	_nCells = (long)_header.dims[0]*_header.dims[1]*_header.dims[2]*_header.azBins*_header.elBins*_header.rollBins;
+	if(memcmp(_header.magic,REACH_MAP_MAGIC,sizeof(REACH_MAP_MAGIC))!=0 || _header.version!=REACH_MAP_VERSION ||
+	   (size_t)st.st_size != sizeof(REACH_MAP_HEADER)+_nCells*_stride*sizeof(float)) {
+		munmap(data,st.st_size);
+		return false;
+	}
+
+	_mapped = data;
+	_mappedSize = st.st_size;
+	_cells = (float*)((char*)data + sizeof(REACH_MAP_HEADER));
+	return true;
+}
+
+bool REACHABILITY_MAP::matches(const std::string& model, const std::string& tip, uint64_t chainHash) const {
+	return _cells && this->model() == model && this->tip() == tip && _header.chainHash == chainHash;
+}
+
+const float* REACHABILITY_MAP::seed(const KDL::Frame& F, float* manipulability) const {
+	if(!_cells) return NULL;
+	long idx = cellIndex(F);
+	if(idx<0) return NULL;
+
+	const float* cell = &_cells[idx*_stride];
+	if(cell[0] <= 0) return NULL;
+	if(manipulability) *manipulability = cell[0];
+	return cell+1;
+}
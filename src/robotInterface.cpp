@@ -0,0 +1,126 @@
+#include "../include/kuka_control/robotInterface.h"
+
+#include <cstring>
+#include <unistd.h>
+
+bool ROS_ROBOT::init(ros::NodeHandle& nh, ros::NodeHandle& pnh) {
+	_spinner.init("joint_states", nh, pnh, _threaded);
+	_js_sub = _spinner.subscribe<sensor_msgs::JointState>(nh, "/iiwa/joint_states", _queueSize, boost::bind(&ROS_ROBOT::joint_states_cb, this, _1), ros::TransportHints().tcpNoDelay());
+	_js_pub = nh.advertise<std_msgs::Float64MultiArray>("/iiwa/jointsCommand", 0);
+	_torque_pub = nh.advertise<std_msgs::Float64MultiArray>("/iiwa/jointsTorqueCommand", 0);
+	_spinner.start();
+	return true;
+}
+
+//Only arm states reach the mailbox, in chain order: other joints sharing the topic would replace the arm sample
+void ROS_ROBOT::joint_states_cb(const sensor_msgs::JointStateConstPtr& js) {
+	sensor_msgs::JointStatePtr arm(new sensor_msgs::JointState);
+	int n = _jsMap.size();
+	arm->position.resize(n);
+	arm->velocity.resize(n);
+	if(!_jsMap.gather(*js, arm->position.data(), arm->velocity.data())) return;
+	arm->header = js->header;
+	if(js->effort.size() == js->position.size()) {
+		arm->effort.resize(n);
+		for(int i=0; i<n; i++) arm->effort[i] = js->effort[_jsMap.index(i)];
+	}
+	_mailbox.post(arm);
+}
+
+sensor_msgs::JointStateConstPtr ROS_ROBOT::waitState(const volatile bool& stop) {
+	sensor_msgs::JointStateConstPtr js;
+	double age;
+	while( ros::ok() && !stop && !(js = _mailbox.take(age)) ) usleep(0.1);
+	return js;
+}
+
+bool ROS_ROBOT::sendCommand(const ROBOT_COMMAND& cmd) {
+	//A new message per tick, published by pointer: in the same nodelet manager it is not serialized
+	std_msgs::Float64MultiArrayPtr jcmd(new std_msgs::Float64MultiArray);
+	jcmd->data.assign(cmd.q, cmd.q+7);
+	_js_pub.publish(jcmd);
+	//Zero torque once when leaving torque mode
+	if(cmd.torque || _torque) {
+		std_msgs::Float64MultiArrayPtr tcmd(new std_msgs::Float64MultiArray);
+		tcmd->data.assign(7, 0.0);
+		if(cmd.torque) tcmd->data.assign(cmd.tau, cmd.tau+7);
+		_torque_pub.publish(tcmd);
+	}
+	_torque = cmd.torque;
+	return true;
+}
+
+void ROS_ROBOT::report() {
+	_spinner.publishStats();
+	STREAM_STATS js = _mailbox.stats();
+	if(js.dropped > 0)
+		ROS_WARN("Joint states: %lu of %lu coalesced, age %.3f ms mean %.3f ms max", js.dropped, js.received, 1e3*js.meanAge(), 1e3*js.maxAge);
+	else
+		ROS_DEBUG("Joint states: %lu received, age %.3f ms mean %.3f ms max", js.received, 1e3*js.meanAge(), 1e3*js.maxAge);
+}
+
+bool SHM_ROBOT::init(ros::NodeHandle& nh, ros::NodeHandle& pnh) {
+	std::string shmName;
+	double shmWait;
+	pnh.param<std::string>("shm_name", shmName, "/kuka_fri");
+	pnh.param("shm_wait", shmWait, 10.0);
+	ros::WallTime waitStart = ros::WallTime::now();
+	while(!_fri.open(shmName)) {
+		if((ros::WallTime::now()-waitStart).toSec() > shmWait) {
+			ROS_ERROR("No FRI bridge on shared memory %s", shmName.c_str());
+			return false;
+		}
+		usleep(100000);
+	}
+	memset(&_cmd, 0, sizeof(_cmd));
+	_cmdSkipped = 0;
+	ROS_INFO("Robot interface: shared memory %s", shmName.c_str());
+	return true;
+}
+
+sensor_msgs::JointStateConstPtr SHM_ROBOT::waitState(const volatile bool& stop) {
+	SHM_JOINT_STATE s;
+	unsigned long skipped = 0;
+	bool got = false;
+	while( ros::ok() && !stop && !(got = _fri.latestState(s, &skipped)) ) usleep(0.1);
+	if(!got) return sensor_msgs::JointStateConstPtr();
+
+	_mutex.lock();
+	_stats.received += skipped+1;
+	_stats.dropped += skipped;
+	_stats.sample(1e-9*(FRI_SHM::now() - s.stamp));
+	_mutex.unlock();
+
+	sensor_msgs::JointStatePtr js(new sensor_msgs::JointState);
+	js->header.stamp = ros::Time::now();
+	js->position.assign(s.q, s.q+FRI_SHM_JOINTS);
+	js->velocity.assign(s.qd, s.qd+FRI_SHM_JOINTS);
+	js->effort.assign(s.tau, s.tau+FRI_SHM_JOINTS);
+	return js;
+}
+
+bool SHM_ROBOT::sendCommand(const ROBOT_COMMAND& cmd) {
+	_cmd.mode = cmd.torque ? SHM_TORQUE : SHM_POSITION;
+	for(int i=0; i<FRI_SHM_JOINTS; i++) {
+		_cmd.q[i] = cmd.q[i];
+		_cmd.tau[i] = cmd.torque ? cmd.tau[i] : 0.0;
+	}
+	if(_fri.sendCommand(_cmd)) return true;
+	ALOG_ERROR(1.0, "FRI bridge shared memory is not open");
+	return false;
+}
+
+void SHM_ROBOT::report() {
+	_mutex.lock();
+	STREAM_STATS js = _stats;
+	_stats.reset();
+	_mutex.unlock();
+	uint64_t skipped = _fri.commandsSkipped();
+	if(skipped > _cmdSkipped)
+		ROS_WARN("Shared memory: %lu commands overwritten before the bridge read them", (unsigned long)(skipped - _cmdSkipped));
+	_cmdSkipped = skipped;
+	if(js.dropped > 0)
+		ROS_WARN("Joint states: %lu of %lu skipped, age %.3f ms mean %.3f ms max", js.dropped, js.received, 1e3*js.meanAge(), 1e3*js.maxAge);
+	else
+		ROS_DEBUG("Joint states: %lu received, age %.3f ms mean %.3f ms max", js.received, 1e3*js.meanAge(), 1e3*js.maxAge);
+}
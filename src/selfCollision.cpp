@@ -0,0 +1,105 @@
+#include "../include/kuka_control/selfCollision.h"
+#include <cmath>
+#include <algorithm>
+
+static const int LANES = 4;
+
+void SELF_COLLISION::resize(int nPairs) {
+	_nPairs = nPairs;
+	//Padding lanes hold degenerate zero-length segments and are left out of the minimum
+	int padded = ((_nPairs + LANES - 1)/LANES)*LANES;
+	for(int c=0; c<12; c++) _p[c].assign(padded,0.0);
+	_rsum.assign(padded,0.0);
+	_clearance.assign(padded,0.0);
+}
+
+void SELF_COLLISION::init(LINK_CAPSULES& capsules, const KDL::JntArray& q_ref, int minGap, double margin) {
+	_margin = margin;
+	_first.clear();
+	_second.clear();
+	for(int i=0; i<capsules.size(); i++)
+		for(int j=i+minGap; j<capsules.size(); j++) {
+			_first.push_back(i);
+			_second.push_back(j);
+		}
+	resize(_first.size());
+
+	//Drop the pairs in contact at the reference configuration
+	capsules.update(q_ref);
+	check(capsules);
+	std::vector<int> first, second;
+	for(int k=0; k<_nPairs; k++)
+		if(_clearance[k] > 0) {
+			first.push_back(_first[k]);
+			second.push_back(_second[k]);
+		}
+	_first = first;
+	_second = second;
+	resize(_first.size());
+}
+
+//Closest points between segments a1-b1 and a2-b2 (Ericson, Real-Time Collision Detection 5.1.9),
+//with selects instead of branches so that the lane loops vectorize
+void SELF_COLLISION::kernel(int first) {
+	const double eps = 1e-12;
+	const double* a1x = &_p[0][first]; const double* a1y = &_p[1][first]; const double* a1z = &_p[2][first];
+	const double* b1x = &_p[3][first]; const double* b1y = &_p[4][first]; const double* b1z = &_p[5][first];
+	const double* a2x = &_p[6][first]; const double* a2y = &_p[7][first]; const double* a2z = &_p[8][first];
+	const double* b2x = &_p[9][first]; const double* b2y = &_p[10][first]; const double* b2z = &_p[11][first];
+	const double* rsum = &_rsum[first];
+	double* out = &_clearance[first];
+
+	for(int k=0; k<LANES; k++) {
+		double d1x = b1x[k]-a1x[k], d1y = b1y[k]-a1y[k], d1z = b1z[k]-a1z[k];
+		double d2x = b2x[k]-a2x[k], d2y = b2y[k]-a2y[k], d2z = b2z[k]-a2z[k];
+		double rx = a1x[k]-a2x[k], ry = a1y[k]-a2y[k], rz = a1z[k]-a2z[k];
+
+		double a = std::max(d1x*d1x + d1y*d1y + d1z*d1z, eps);
+		double e = std::max(d2x*d2x + d2y*d2y + d2z*d2z, eps);
+		double b = d1x*d2x + d1y*d2y + d1z*d2z;
+		double c = d1x*rx + d1y*ry + d1z*rz;
+		double f = d2x*rx + d2y*ry + d2z*rz;
+		double denom = a*e - b*b;
+
+		double s = (denom > eps) ? std::min(1.0, std::max(0.0, (b*f - c*e)/denom)) : 0.0;
+		double t = (b*s + f)/e;
+		double sLow = std::min(1.0, std::max(0.0, -c/a));
+		double sHigh = std::min(1.0, std::max(0.0, (b-c)/a));
+		s = (t < 0.0) ? sLow : ((t > 1.0) ? sHigh : s);
+		t = std::min(1.0, std::max(0.0, t));
+
+		double dx = rx + d1x*s - d2x*t;
+		double dy = ry + d1y*s - d2y*t;
+		double dz = rz + d1z*s - d2z*t;
+		out[k] = sqrt(dx*dx + dy*dy + dz*dz) - rsum[k];
+	}
+}
+
+double SELF_COLLISION::check(const LINK_CAPSULES& capsules, int* worst) {
+	for(int k=0; k<_nPairs; k++) {
+		const Eigen::Vector3d& a1 = capsules.a(_first[k]);
+		const Eigen::Vector3d& b1 = capsules.b(_first[k]);
+		const Eigen::Vector3d& a2 = capsules.a(_second[k]);
+		const Eigen::Vector3d& b2 = capsules.b(_second[k]);
+		for(int i=0; i<3; i++) {
+			_p[i][k] = a1(i);
+			_p[3+i][k] = b1(i);
+			_p[6+i][k] = a2(i);
+			_p[9+i][k] = b2(i);
+		}
+		_rsum[k] = capsules.radius(_first[k]) + capsules.radius(_second[k]) + _margin;
+	}
+
+	for(unsigned int k=0; k<_rsum.size(); k+=LANES)
+		kernel(k);
+
+	double minClearance = 1e9;
+	int w = -1;
+	for(int k=0; k<_nPairs; k++)
+		if(_clearance[k] < minClearance) {
+			minClearance = _clearance[k];
+			w = k;
+		}
+	if(worst) *worst = w;
+	return minClearance;
+}
@@ -0,0 +1,62 @@
+#include <kdl_parser/kdl_parser.hpp>
+
+#include "../include/kuka_control/linkCapsules.h"
+#include "../include/kuka_control/selfCollision.h"
+
+#include <iostream>
+#include <cstdlib>
+#include <chrono>
+#include <algorithm>
+
+using namespace std;
+
+//Usage: selfCollisionBench <urdf> [n_configurations]
+//Times capsule update + self-collision check per commanded configuration (control loop budget: 20us)
+int main(int argc, char** argv) {
+
+	if(argc<2) {
+		cout<<"Usage: selfCollisionBench <urdf> [n_configurations]"<<endl;
+		return 1;
+	}
+	int N = (argc>2) ? atoi(argv[2]) : 100000;
+
+	KDL::Tree tree;
+	KDL::Chain chain;
+	if(!kdl_parser::treeFromFile(argv[1], tree) || !tree.getChain("iiwa_link_0", "iiwa_link_sensor_kuka", chain)) {
+		cout<<"Failed to construct kdl chain"<<endl;
+		return 1;
+	}
+
+	LINK_CAPSULES capsules;
+	if(!capsules.init(chain, "iiwa_link_0", iiwa7Capsules())) {
+		cout<<"Link capsules do not match the chain"<<endl;
+		return 1;
+	}
+	SELF_COLLISION selfCollision;
+	KDL::JntArray q(chain.getNrOfJoints());
+	selfCollision.init(capsules, q);
+	cout<<"Monitored pairs: "<<selfCollision.size()<<endl;
+
+	typedef std::chrono::steady_clock clock;
+	std::vector<double> t(N);
+	int collisions = 0;
+	srand(0);
+	for(int k=0; k<N; k++) {
+		for(unsigned int j=0; j<q.rows(); j++)
+			q(j) = 2.0*(2.0*rand()/RAND_MAX - 1.0);
+
+		clock::time_point start = clock::now();
+		capsules.update(q);
+		double clearance = selfCollision.check(capsules);
+		t[k] = std::chrono::duration<double,std::micro>(clock::now()-start).count();
+		if(clearance < 0) collisions++;
+	}
+
+	std::sort(t.begin(), t.end());
+	double mean = 0;
+	for(int k=0; k<N; k++) mean += t[k]/N;
+	cout<<"Update + check [us]: mean "<<mean<<"  p99 "<<t[(int)(0.99*(N-1))]<<"  p99.9 "<<t[(int)(0.999*(N-1))]<<"  max "<<t[N-1]<<endl;
+	cout<<"Colliding configurations: "<<100.0*collisions/N<<"%"<<endl;
+
+	return 0;
+}
@@ -0,0 +1,88 @@
+#include "../include/kuka_control/friShm.h"
+#include "../include/kuka_control/tickBudget.h"
+
+#include <iostream>
+#include <cstdlib>
+#include <csignal>
+#include <time.h>
+#include <sys/prctl.h>
+
+using namespace std;
+
+//Stand-in for the FRI bridge on the shared memory transport, without the robot: a new state every
+//period from the last accepted command (the arm follows the position command exactly), commands
+//polled every poll_us. The latency from the controller write to the pickup here is what the real
+//bridge adds before the command goes on the wire
+
+static volatile sig_atomic_t running = 1;
+static void onSignal(int) {running = 0;}
+
+//Usage: shmBridge [segment] [period_ms] [poll_us] [max_age_ms]
+int main(int argc, char** argv) {
+
+	std::string name = (argc>1) ? argv[1] : "/kuka_fri";
+	double period = 1e-3*((argc>2) ? atof(argv[2]) : 5.0);
+	double poll = 1e-6*((argc>3) ? atof(argv[3]) : 20.0);
+	double maxAge = 1e-3*((argc>4) ? atof(argv[4]) : 20.0); //older commands are not applied
+
+	FRI_SHM shm;
+	if(!shm.create(name)) {
+		cerr<<"Cannot create shared memory segment "<<name<<endl;
+		return 1;
+	}
+	//Default timer slack (50 us) would dominate the polling period
+	prctl(PR_SET_TIMERSLACK, 1000UL);
+	signal(SIGINT, onSignal);
+	signal(SIGTERM, onSignal);
+	cout<<"Bridge stand-in on "<<name<<": state every "<<period*1e3<<" ms, commands polled every "<<poll*1e6<<" us"<<endl;
+
+	SHM_JOINT_STATE state = SHM_JOINT_STATE();
+	SHM_JOINT_COMMAND cmd;
+	double qPrev[FRI_SHM_JOINTS] = {0};
+	TICK_BUDGET latency;
+	latency.init(1e-7, 0.01);
+	unsigned long received = 0, skipped = 0, stale = 0;
+
+	uint64_t periodNs = (uint64_t)(period*1e9);
+	uint64_t nextState = FRI_SHM::now();
+	uint64_t nextReport = nextState + 5000000000ULL;
+	timespec pollTime = {0, (long)(poll*1e9)};
+	while(running) {
+		uint64_t t = FRI_SHM::now();
+		if(shm.latestCommand(cmd, &skipped)) {
+			double age = 1e-9*(t - cmd.stamp);
+			latency.add(age);
+			received++;
+			if(age > maxAge)
+				stale++;
+			else {
+				if(cmd.mode == SHM_POSITION)
+					for(int i=0; i<FRI_SHM_JOINTS; i++) state.q[i] = cmd.q[i];
+				for(int i=0; i<FRI_SHM_JOINTS; i++) state.tau[i] = cmd.tau[i];
+			}
+		}
+
+		if(t >= nextState) {
+			for(int i=0; i<FRI_SHM_JOINTS; i++) {
+				state.qd[i] = (state.q[i] - qPrev[i])/period;
+				qPrev[i] = state.q[i];
+			}
+			shm.sendState(state);
+			nextState += periodNs;
+		}
+
+		if(t >= nextReport) {
+			cout<<"Commands: "<<received<<" received, "<<skipped<<" skipped, "<<stale<<" stale"<<endl;
+			if(latency.count() > 0)
+				cout<<"Command to bridge: p50 "<<1e6*latency.percentile(50)<<" us, p99 "<<1e6*latency.percentile(99)<<" us, max "<<1e6*latency.max()<<" us"<<endl;
+			latency.reset();
+			received = skipped = stale = 0;
+			nextReport += 5000000000ULL;
+		}
+
+		nanosleep(&pollTime, 0);
+	}
+
+	shm.close();
+	return 0;
+}